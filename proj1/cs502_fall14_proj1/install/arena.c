@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <assert.h>
+#include "arena.h"
+
+/* 
+ * Current chunk is full, start a new one. Chunks double in size so
+ * a big function only needs a few of them.
+ */
+void *arenaGrow(Arena *pArena, size_t size)
+{
+	size_t chunkSize = ARENA_CHUNK_SIZE;
+	ArenaChunk *pChunk;
+
+	if (pArena->head && pArena->head->size >= chunkSize)
+		chunkSize = pArena->head->size << 1;
+
+	while (chunkSize < size)
+		chunkSize <<= 1;
+
+	pChunk = (ArenaChunk *) xmalloc(sizeof(ArenaChunk) + chunkSize);
+	pChunk->size = chunkSize;
+	pChunk->next = pArena->head;
+
+	pArena->head = pChunk;
+	pArena->cur = pChunk->data + size;
+	pArena->end = pChunk->data + chunkSize;
+
+	return pChunk->data;
+}
+
+char *arenaStrdup(Arena *pArena, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	char *ptr = (char *) arenaAlloc(pArena, len);
+
+	memcpy(ptr, str, len);
+
+	return ptr;
+}
+
+/* 
+ * Release everything allocated so far. The newest (largest) chunk
+ * is kept, so the next function of a similar size does not have to
+ * malloc at all.
+ */
+void arenaReset(Arena *pArena)
+{
+	ArenaChunk *pChunk = pArena->head;
+
+	if (!pChunk)
+		return;
+
+	while (pChunk->next) {
+		ArenaChunk *ptr = pChunk->next;
+
+		pChunk->next = ptr->next;
+		free(ptr);
+	}
+
+	pArena->cur = pChunk->data;
+	pArena->end = pChunk->data + pChunk->size;
+}
+
+void arenaFree(Arena *pArena)
+{
+	ArenaChunk *pChunk = pArena->head;
+
+	while (pChunk) {
+		ArenaChunk *ptr = pChunk;
+
+		pChunk = pChunk->next;
+		free(ptr);
+	}
+
+	pArena->head = NULL;
+	pArena->cur = pArena->end = NULL;
+}
@@ -0,0 +1,50 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include "config.h"
+#include "system.h"
+
+/*
+ * Bump allocator. Everything that lives as long as the analysis of
+ * one function (CFGNodes, operands, node info, interned names) is
+ * carved out of large chunks, so an allocation is a pointer bump and
+ * the whole function is released by a single arenaReset().
+ */
+#define ARENA_ALIGN			16
+#define ARENA_CHUNK_SIZE	(64 * 1024)
+
+typedef struct ArenaChunk {
+	struct ArenaChunk *next;
+	size_t size;
+	char data[] __attribute__((aligned(ARENA_ALIGN)));
+} ArenaChunk;
+
+typedef struct Arena {
+	/* Chunk list, current chunk first */
+	ArenaChunk *head;
+	/* Free space of the current chunk */
+	char *cur;
+	char *end;
+} Arena;
+
+void *arenaGrow(Arena *pArena, size_t size);
+char *arenaStrdup(Arena *pArena, const char *str);
+void arenaReset(Arena *pArena);
+void arenaFree(Arena *pArena);
+
+static inline void *arenaAlloc(Arena *pArena, size_t size)
+{
+	void *ptr;
+
+	size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+	if ((size_t) (pArena->end - pArena->cur) < size)
+		return arenaGrow(pArena, size);
+
+	ptr = pArena->cur;
+	pArena->cur += size;
+
+	return ptr;
+}
+
+#endif
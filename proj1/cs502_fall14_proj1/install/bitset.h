@@ -0,0 +1,127 @@
+#ifndef _BIT_SET_H_
+#define _BIT_SET_H_
+
+#include "config.h"
+#include "system.h"
+
+/*
+ * Word-packed bit-vector sets. Every interned variable owns a dense
+ * index, so the in/out/def/use sets of a CFGNode can be stored as
+ * arrays of machine words and combined a whole word at a time.
+ */
+typedef unsigned long BitWord;
+
+#define BITWORD_BITS	(sizeof(BitWord) * 8)
+#define BITSET_WORDS(n)	(((n) + BITWORD_BITS - 1) / BITWORD_BITS)
+
+static inline void bitSet(BitWord *set, int idx)
+{
+	set[idx / BITWORD_BITS] |= (BitWord) 1 << (idx % BITWORD_BITS);
+}
+
+static inline bool bitTest(const BitWord *set, int idx)
+{
+	return (set[idx / BITWORD_BITS] >> (idx % BITWORD_BITS)) & 1;
+}
+
+static inline void bitZero(BitWord *set, int words)
+{
+	memset(set, 0, sizeof(BitWord) * words);
+}
+
+static inline bool bitEmpty(const BitWord *set, int words)
+{
+	int i;
+
+	for (i=0; i<words; i++) {
+		if (set[i])
+			return false;
+	}
+
+	return true;
+}
+
+/* dst |= src */
+static inline void bitOr(BitWord *dst, const BitWord *src, int words)
+{
+	int i;
+
+	for (i=0; i<words; i++)
+		dst[i] |= src[i];
+}
+
+/* Copy src to dst, return true if dst changed */
+static inline bool bitCopy(BitWord *dst, const BitWord *src, int words)
+{
+	bool changed = false;
+	int i;
+
+	for (i=0; i<words; i++) {
+		if (dst[i] != src[i]) {
+			dst[i] = src[i];
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+/*
+ * Backward liveness transfer: in = use | (out & ~def).
+ * Return true if the in set changed.
+ */
+static inline bool bitTransfer(BitWord *in, const BitWord *use,
+	const BitWord *out, const BitWord *def, int words)
+{
+	bool changed = false;
+	int i;
+
+	for (i=0; i<words; i++) {
+		BitWord val = use[i] | (out[i] & ~def[i]);
+
+		if (val != in[i]) {
+			in[i] = val;
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+/* Number of members of set */
+static inline int bitCount(const BitWord *set, int words)
+{
+	int i, num = 0;
+
+	for (i=0; i<words; i++)
+		num += __builtin_popcountl(set[i]);
+
+	return num;
+}
+
+/*
+ * Return the first index >= idx set in both a and b (b may be NULL),
+ * or -1 if there is none.
+ */
+static inline int bitNextAnd(const BitWord *a, const BitWord *b,
+	int words, int idx)
+{
+	int w = idx / BITWORD_BITS;
+	BitWord val;
+
+	if (w >= words)
+		return -1;
+
+	val = a[w] & (b ? b[w] : ~(BitWord) 0);
+	val &= ~(BitWord) 0 << (idx % BITWORD_BITS);
+
+	while (!val) {
+		if (++w >= words)
+			return -1;
+		val = a[w] & (b ? b[w] : ~(BitWord) 0);
+	}
+
+	return w * BITWORD_BITS + __builtin_ctzl(val);
+}
+
+#endif
@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cache.h"
+#include "trace.h"
+
+FuncCache gCache;
+
+/* Whether the open file is a cache of this version and layout */
+static bool cacheValid(int fd, size_t mapSize)
+{
+	CacheHeader head;
+	struct stat st;
+
+	return fstat(fd, &st) == 0 && (size_t) st.st_size == mapSize && 
+		pread(fd, &head, sizeof(head), 0) == sizeof(head) &&
+		head.magic == CACHE_MAGIC && head.version == CACHE_VERSION &&
+		head.slotNum == CACHE_SLOT_NUM && head.slotSize == sizeof(CacheSlot);
+}
+
+/* 
+ * Write an empty cache to a temporary file next to path and rename it
+ * over path. A file of another version is never truncated in place,
+ * since other runs may have it mapped and would fault on the pages cut
+ * off; they keep using the old file until they exit.
+ */
+static bool cacheCreate(const char *path, size_t mapSize)
+{
+	char *tmp = (char *) xmalloc(strlen(path) + 8);
+	CacheHeader head;
+	mode_t mask;
+	bool ok;
+	int fd;
+
+	sprintf(tmp, "%s.XXXXXX", path);
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		free(tmp);
+		return false;
+	}
+
+	memset(&head, 0, sizeof(head));
+	head.magic = CACHE_MAGIC;
+	head.version = CACHE_VERSION;
+	head.slotNum = CACHE_SLOT_NUM;
+	head.slotSize = sizeof(CacheSlot);
+
+	/* mkstemp() makes the file private, give it the usual mode */
+	mask = umask(0);
+	umask(mask);
+
+	ok = fchmod(fd, 0666 & ~mask) == 0 && ftruncate(fd, mapSize) == 0 &&
+		pwrite(fd, &head, sizeof(head), 0) == sizeof(head);
+	close(fd);
+
+	ok = ok && rename(tmp, path) == 0;
+	if (!ok)
+		unlink(tmp);
+	free(tmp);
+
+	return ok;
+}
+
+/* 
+ * Map the cache file named by CS502_CACHE, replacing it first when it
+ * is missing or from another version. Runs racing to replace it each
+ * map whichever file is in place when they open it again.
+ */
+void cacheInit(void)
+{
+	char *path = getenv("CS502_CACHE");
+	size_t mapSize = sizeof(CacheHeader) + 
+		sizeof(CacheSlot) * CACHE_SLOT_NUM;
+	void *pMap;
+	int fd;
+
+	memset(&gCache, 0, sizeof(FuncCache));
+
+	if (!path)
+		return;
+
+	fd = open(path, O_RDWR);
+	if (fd >= 0 && !cacheValid(fd, mapSize)) {
+		close(fd);
+		fd = -1;
+	}
+
+	if (fd < 0) {
+		if (!cacheCreate(path, mapSize) || (fd = open(path, O_RDWR)) < 0) {
+			fprintf(stderr, "cannot create cache file %s\n", path);
+			return;
+		}
+		if (!cacheValid(fd, mapSize)) {
+			fprintf(stderr, "cannot use cache file %s\n", path);
+			close(fd);
+			return;
+		}
+	}
+
+	pMap = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (pMap == MAP_FAILED) {
+		fprintf(stderr, "cannot map cache file %s\n", path);
+		return;
+	}
+
+	gCache.pHead = (CacheHeader *) pMap;
+	gCache.slots = (CacheSlot *) (gCache.pHead + 1);
+	gCache.mapSize = mapSize;
+	gCache.pid = getpid();
+}
+
+void cacheFin(void)
+{
+	if (!gCache.pHead)
+		return;
+
+	if (TRACE_ON(TRACE_CFG)) {
+		fprintf(gTraceFile, 
+			"cache: %d hits, %d misses, %d replaced, %d too long, "
+			"%d not stored, %lu hits, %lu misses and %lu replaced "
+			"over all runs\n", 
+			gCache.hits, gCache.misses, gCache.replaced, gCache.tooLong,
+			gCache.dropped, gCache.pHead->hits, gCache.pHead->misses, 
+			gCache.pHead->replaced);
+	}
+
+	munmap(gCache.pHead, gCache.mapSize);
+	memset(&gCache, 0, sizeof(FuncCache));
+}
+
+/* 
+ * Write the cached result of key to file, if there is one. The text is
+ * copied out first and only used if the state word of the slot did not
+ * change meanwhile, since another run may be replacing it.
+ */
+bool cacheLookup(unsigned long key, FILE *file)
+{
+	char text[CACHE_TEXT_MAX];
+	int i;
+
+	for (i=0; i<CACHE_PROBE_MAX; i++) {
+		CacheSlot *pSlot = 
+			&gCache.slots[(key + i) & (CACHE_SLOT_NUM - 1)];
+		unsigned long state = *(volatile unsigned long *) &pSlot->state;
+		unsigned int seq = CACHE_SEQ(state);
+		unsigned int len;
+
+		/* Slots are never freed, so a run has no holes */
+		if (seq == 0)
+			break;
+		if (seq & 1)
+			continue;
+
+		/* The slot is only read after it was seen ready */
+		__sync_synchronize();
+
+		len = *(volatile unsigned int *) &pSlot->len;
+		if (pSlot->key != key || len > CACHE_TEXT_MAX)
+			continue;
+		memcpy(text, pSlot->text, len);
+
+		__sync_synchronize();
+		if (*(volatile unsigned long *) &pSlot->state != state)
+			continue;
+
+		fwrite(text, 1, len, file);
+		pSlot->stamp = __sync_add_and_fetch(&gCache.pHead->clock, 1);
+		__sync_fetch_and_add(&gCache.hits, 1);
+		__sync_fetch_and_add(&gCache.pHead->hits, 1);
+		return true;
+	}
+
+	__sync_fetch_and_add(&gCache.misses, 1);
+	__sync_fetch_and_add(&gCache.pHead->misses, 1);
+
+	return false;
+}
+
+/* Whether a slot being filled was left so by a writer that is gone */
+static bool cacheOrphan(unsigned long state)
+{
+	int pid = CACHE_PID(state);
+
+	return pid != gCache.pid && kill(pid, 0) < 0 && errno == ESRCH;
+}
+
+/* 
+ * Store the result of key in its probe run: in the first free slot, or
+ * else in the one least recently used, a slot abandoned by a dead
+ * writer going first. Nothing is stored if the text is too long, the
+ * key is there already or another run took the chosen slot first.
+ */
+void cacheStore(unsigned long key, const char *text, size_t len)
+{
+	CacheSlot *pVictim = NULL;
+	unsigned long victimState = 0, oldest = 0;
+	unsigned long newState;
+	int i;
+
+	if (len > CACHE_TEXT_MAX) {
+		__sync_fetch_and_add(&gCache.tooLong, 1);
+		return;
+	}
+
+	for (i=0; i<CACHE_PROBE_MAX; i++) {
+		CacheSlot *pSlot = 
+			&gCache.slots[(key + i) & (CACHE_SLOT_NUM - 1)];
+		unsigned long state = *(volatile unsigned long *) &pSlot->state;
+		unsigned int seq = CACHE_SEQ(state);
+
+		if (seq == 0) {
+			pVictim = pSlot;
+			victimState = state;
+			break;
+		}
+
+		if (seq & 1) {
+			if (cacheOrphan(state)) {
+				pVictim = pSlot;
+				victimState = state;
+				oldest = 0;
+			}
+			continue;
+		}
+
+		__sync_synchronize();
+		if (pSlot->key == key)
+			return;
+
+		if (!pVictim || pSlot->stamp < oldest) {
+			pVictim = pSlot;
+			victimState = state;
+			oldest = pSlot->stamp;
+		}
+	}
+
+	/* 
+	 * Claiming moves the count to the next odd number, so readers of
+	 * the old text see the state change. An orphaned slot is already
+	 * odd and skips one.
+	 */
+	newState = CACHE_STATE(gCache.pid, CACHE_SEQ(victimState) + 
+		(CACHE_SEQ(victimState) & 1 ? 2 : 1));
+	if (!pVictim || 
+		!__sync_bool_compare_and_swap(&pVictim->state, victimState, newState))
+	{
+		__sync_fetch_and_add(&gCache.dropped, 1);
+		return;
+	}
+
+	if (CACHE_SEQ(victimState)) {
+		__sync_fetch_and_add(&gCache.replaced, 1);
+		__sync_fetch_and_add(&gCache.pHead->replaced, 1);
+	}
+
+	pVictim->key = key;
+	pVictim->len = len;
+	memcpy(pVictim->text, text, len);
+	pVictim->stamp = __sync_add_and_fetch(&gCache.pHead->clock, 1);
+
+	/* 
+	 * Everything is in place before the slot turns ready. The swap
+	 * fails only if the slot was taken over, the text is dropped then.
+	 */
+	if (!__sync_bool_compare_and_swap(&pVictim->state, newState, 
+		newState + 1))
+		__sync_fetch_and_add(&gCache.dropped, 1);
+}
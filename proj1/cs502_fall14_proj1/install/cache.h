@@ -0,0 +1,92 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include "config.h"
+#include "system.h"
+
+/*
+ * Results of earlier runs, kept in a file named by CS502_CACHE and
+ * shared by every compiler run pointing at it. The file is mapped and
+ * holds a fixed table of slots, each with the output.txt text of one
+ * function keyed by a structural hash of the function (funcKey() in
+ * csproj2.c). Without CS502_CACHE there is no cache.
+ *
+ * A key lives in one of the CACHE_PROBE_MAX slots from its home slot.
+ * A store takes the first free one and, once the run is full, replaces
+ * the slot used longest ago, so a long-lived file keeps the recent
+ * results. Slots are claimed and published by compare-and-swap on
+ * their state word and readers copy a slot optimistically, checking
+ * afterwards that it was not replaced under them, so concurrent runs
+ * need no lock. Runs sharing a file must see each other's pids: a slot
+ * left half-written by a writer that died is taken over once that pid
+ * is gone. Bump CACHE_VERSION whenever the analysis changes its output
+ * or the layout changes, the file is replaced on a mismatch.
+ */
+#define CACHE_VERSION	4
+#define CACHE_MAGIC	0x32303553
+#define CACHE_SLOT_NUM	65536
+/* Slots tried from the home slot of a key */
+#define CACHE_PROBE_MAX	16
+/* 
+ * Results longer than this are not cached and are counted as too long
+ * in the trace and the stats. A slot is about 256 bytes, which holds
+ * the line of a function with a few dozen findings.
+ */
+#define CACHE_TEXT_MAX	240
+
+/* 
+ * State word of a slot: the low half counts stores, the high half is
+ * the pid of the writer filling it. A count of 0 is a free slot, an
+ * odd count a slot being filled and an even one a ready slot.
+ */
+#define CACHE_SEQ(state)	((unsigned int) (state))
+#define CACHE_PID(state)	((int) ((state) >> 32))
+#define CACHE_STATE(pid, seq)	\
+	((unsigned long) (unsigned int) (pid) << 32 | (unsigned int) (seq))
+
+typedef struct CacheSlot {
+	unsigned long key;
+	unsigned long state;
+	/* Header clock at the last store or hit of the slot */
+	unsigned long stamp;
+	unsigned int len;
+	char text[CACHE_TEXT_MAX];
+} CacheSlot;
+
+typedef struct CacheHeader {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int slotNum;
+	unsigned int slotSize;
+	/* Counts over all runs sharing the file */
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long replaced;
+	/* Ticks on every store and hit, orders the slots by last use */
+	unsigned long clock;
+	char pad[16];
+} CacheHeader;
+
+typedef struct FuncCache {
+	CacheHeader *pHead;
+	CacheSlot *slots;
+	size_t mapSize;
+	/* Writer pid put in the state of claimed slots */
+	int pid;
+	/* Counts of this run */
+	int hits;
+	int misses;
+	int replaced;
+	int tooLong;
+	int dropped;
+} FuncCache;
+
+/* Set up by cacheInit(), pHead is NULL when there is no cache */
+extern FuncCache gCache;
+
+void cacheInit(void);
+void cacheFin(void);
+bool cacheLookup(unsigned long key, FILE *file);
+void cacheStore(unsigned long key, const char *text, size_t len);
+
+#endif
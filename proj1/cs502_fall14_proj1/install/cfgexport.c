@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <assert.h>
+#include "csproj2.h"
+#include "cfgexport.h"
+
+FILE *gCfgFile = NULL;
+
+/* String section of a record under construction */
+typedef struct CfgxStrings {
+	char *buf;
+	int len;
+	int cap;
+} CfgxStrings;
+
+static int32_t cfgxString(CfgxStrings *pStr, const char *str)
+{
+	int len;
+	int32_t off = pStr->len;
+
+	if (!str)
+		return -1;
+
+	len = strlen(str) + 1;
+	if (pStr->len + len > pStr->cap) {
+		while (pStr->len + len > pStr->cap)
+			pStr->cap = pStr->cap ? pStr->cap << 1 : 1024;
+		pStr->buf = (char *) xrealloc(pStr->buf, pStr->cap);
+	}
+
+	memcpy(pStr->buf + pStr->len, str, len);
+	pStr->len += len;
+
+	return off;
+}
+
+static uint32_t cfgxAlign(uint32_t off)
+{
+	return (off + 7) & ~7u;
+}
+
+void cfgExportInit(void)
+{
+	char *path = getenv("CS502_CFG_FILE");
+
+	gCfgFile = NULL;
+
+	if (!path)
+		return;
+
+	gCfgFile = fopen(path, "wb");
+	if (!gCfgFile)
+		fprintf(stderr, "cannot open CFG file %s\n", path);
+}
+
+void cfgExportFin(void)
+{
+	if (gCfgFile)
+		fclose(gCfgFile);
+
+	gCfgFile = NULL;
+}
+
+/*
+ * Write the CFG of the function just analyzed as one record, see
+ * cfgexport.h. Node ids, edges and the bind table are the ones
+ * initDFA built, so this runs after doDFA and before fin().
+ */
+void cfgExport(AnalysisCtx *pCtx, FILE *file, CFGNode *pEntry, 
+	const char *funcName)
+{
+	CfgxStrings str;
+	CfgxFunc head;
+	CfgxNode *nodes;
+	CfgxBind *binds;
+	CfgxDecl *decls;
+	CfgxVar *vars;
+	int32_t *succs, *ops, *bindOf;
+	int numNode = pCtx->numNode;
+	int numBind = pCtx->numBindNode;
+	int edgeNum = 0, opNum = 0, declNum = 0;
+	char *rec;
+	CFGNode *ptr;
+	Operand *pOp;
+	tree decl;
+	int i, j;
+
+	memset(&str, 0, sizeof(str));
+	memset(&head, 0, sizeof(head));
+
+	for (ptr=pCtx->cfgList; ptr; ptr=ptr->nextCFG) {
+		edgeNum += ptr->succNum;
+		for (pOp=ptr->defOp; pOp; pOp=pOp->next)
+			opNum++;
+		for (pOp=ptr->useOp; pOp; pOp=pOp->next)
+			opNum++;
+	}
+
+	bindOf = (int32_t *) xmalloc(sizeof(int32_t) * (numNode + 1));
+	for (i=0; i<numNode; i++)
+		bindOf[i] = -1;
+	for (i=0; i<numBind; i++) {
+		bindOf[pCtx->bindTable[i]->id] = i;
+		for (decl=pCtx->bindTable[i]->decls; decl; decl=DECL_CHAIN(decl))
+			declNum++;
+	}
+
+	head.magic = CFGX_MAGIC;
+	head.version = CFGX_VERSION;
+	head.nodeNum = numNode;
+	head.edgeNum = edgeNum;
+	head.opNum = opNum;
+	head.varNum = pCtx->varNum;
+	head.bindNum = numBind;
+	head.declNum = declNum;
+	head.entry = pEntry ? pEntry->id : -1;
+
+	head.nodeOff = cfgxAlign(sizeof(CfgxFunc));
+	head.succOff = cfgxAlign(head.nodeOff + sizeof(CfgxNode) * numNode);
+	head.opOff = cfgxAlign(head.succOff + sizeof(int32_t) * edgeNum);
+	head.varOff = cfgxAlign(head.opOff + sizeof(int32_t) * opNum);
+	head.bindOff = cfgxAlign(head.varOff + sizeof(CfgxVar) * pCtx->varNum);
+	head.declOff = cfgxAlign(head.bindOff + sizeof(CfgxBind) * numBind);
+	head.strOff = cfgxAlign(head.declOff + sizeof(CfgxDecl) * declNum);
+
+	/* Strings are collected first, the size of the record follows */
+	rec = (char *) xcalloc(head.strOff, 1);
+	nodes = (CfgxNode *) (rec + head.nodeOff);
+	succs = (int32_t *) (rec + head.succOff);
+	ops = (int32_t *) (rec + head.opOff);
+	vars = (CfgxVar *) (rec + head.varOff);
+	binds = (CfgxBind *) (rec + head.bindOff);
+	decls = (CfgxDecl *) (rec + head.declOff);
+
+	head.name = cfgxString(&str, funcName);
+
+	for (i=0, edgeNum=0, opNum=0, ptr=pCtx->cfgList; ptr; 
+		ptr=ptr->nextCFG, i++) 
+	{
+		CfgxNode *pNode = &nodes[i];
+
+		assert(ptr->id == i);
+		pNode->type = ptr->nType;
+		pNode->info = cfgxString(&str, ptr->info);
+		pNode->bind = bindOf[i];
+
+		pNode->succFirst = edgeNum;
+		pNode->succNum = ptr->succNum;
+		for (j=0; j<ptr->succNum; j++)
+			succs[edgeNum++] = ptr->succs[j]->id;
+
+		pNode->defFirst = opNum;
+		for (pOp=ptr->defOp; pOp; pOp=pOp->next)
+			ops[opNum++] = pOp->id;
+		pNode->defNum = opNum - pNode->defFirst;
+
+		pNode->useFirst = opNum;
+		for (pOp=ptr->useOp; pOp; pOp=pOp->next)
+			ops[opNum++] = pOp->id;
+		pNode->useNum = opNum - pNode->useFirst;
+	}
+
+	for (i=0; i<pCtx->varNum; i++) {
+		Variable *pVar = pCtx->varList[i];
+
+		vars[i].name = cfgxString(&str, pVar->name);
+		vars[i].bind = pVar->pBind ? bindOf[pVar->pBind->id] : -1;
+		vars[i].decl = pVar->pBind ? pVar->declIdx : -1;
+	}
+
+	for (i=0, declNum=0; i<numBind; i++) {
+		CFGNode *pBind = pCtx->bindTable[i];
+		CfgxBind *pRec = &binds[i];
+
+		pRec->node = pBind->id;
+		pRec->parent = pBind->parentBind ? bindOf[pBind->parentBind->id] : -1;
+		pRec->scope = pBind->scopeId;
+		pRec->child = pBind->childIdx;
+		pRec->declFirst = declNum;
+
+		for (decl=pBind->decls; decl; decl=DECL_CHAIN(decl)) {
+			CfgxDecl *pDecl = &decls[declNum++];
+
+			pDecl->isVar = TREE_CODE(decl) == VAR_DECL;
+			pDecl->name = DECL_NAME(decl) ? 
+				cfgxString(&str, IDENTIFIER_POINTER(DECL_NAME(decl))) : -1;
+		}
+		pRec->declNum = declNum - pRec->declFirst;
+	}
+
+	head.size = cfgxAlign(head.strOff + str.len);
+	memcpy(rec, &head, sizeof(head));
+
+	fwrite(rec, 1, head.strOff, file);
+	fwrite(str.buf, 1, str.len, file);
+	for (i=head.strOff+str.len; i<head.size; i++)
+		fputc(0, file);
+
+	free(rec);
+	free(str.buf);
+	free(bindOf);
+}
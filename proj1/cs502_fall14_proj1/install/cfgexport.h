@@ -0,0 +1,96 @@
+#ifndef _CFG_EXPORT_H_
+#define _CFG_EXPORT_H_
+
+#include <stdint.h>
+#include "config.h"
+#include "system.h"
+
+/*
+ * Binary CFG export. With CS502_CFG_FILE set, the CFG of every
+ * analyzed function is appended to that file as one record, so the
+ * solver can be run offline by cfgload without the front end.
+ *
+ * A record is a CfgxFunc header followed by its sections. Every
+ * section is an array of fixed-size 32-bit fields at an 8-byte aligned
+ * offset from the start of the record, so a mapped file is read in
+ * place. Fields are in the byte order of the host that wrote them; the
+ * magic tells it, a reader of the other order sees CFGX_MAGIC_SWAPPED.
+ * Strings are offsets into the string section, -1 for none. Nodes are
+ * in cfgList order, their index is the node id.
+ */
+#define CFGX_MAGIC		0x58474643
+#define CFGX_MAGIC_SWAPPED	0x43464758
+#define CFGX_VERSION	3
+
+typedef struct CfgxFunc {
+	uint32_t magic;
+	uint32_t version;
+	/* Bytes of the whole record, a multiple of 8 */
+	uint32_t size;
+	int32_t name;
+	int32_t nodeNum;
+	int32_t edgeNum;
+	int32_t opNum;
+	int32_t varNum;
+	int32_t bindNum;
+	int32_t declNum;
+	/* First statement of the function, -1 for an empty one */
+	int32_t entry;
+	/* Section offsets from the start of the record */
+	uint32_t nodeOff;
+	uint32_t succOff;
+	uint32_t opOff;
+	uint32_t varOff;
+	uint32_t bindOff;
+	uint32_t declOff;
+	uint32_t strOff;
+} CfgxFunc;
+
+/* Successors, defs and uses are ranges of the succ and op sections */
+typedef struct CfgxNode {
+	int32_t type;
+	int32_t info;
+	int32_t succFirst;
+	int32_t succNum;
+	int32_t defFirst;
+	int32_t defNum;
+	int32_t useFirst;
+	int32_t useNum;
+	/* Index in the bind section, -1 for other nodes */
+	int32_t bind;
+} CfgxNode;
+
+/* Bind scope, with the range of its declarations in the decl section */
+typedef struct CfgxBind {
+	int32_t node;
+	/* Enclosing bind, -1 at the top */
+	int32_t parent;
+	/* Preorder scope number and index among the parent's children */
+	int32_t scope;
+	int32_t child;
+	int32_t declFirst;
+	int32_t declNum;
+} CfgxBind;
+
+/* A declaration of a bind, in DECL_CHAIN order */
+typedef struct CfgxDecl {
+	/* Nonzero for a VAR_DECL */
+	int32_t isVar;
+	int32_t name;
+} CfgxDecl;
+
+/* A variable, the var section is indexed by variable id */
+typedef struct CfgxVar {
+	int32_t name;
+	/* Declaring bind and decl index in it, -1 for none */
+	int32_t bind;
+	int32_t decl;
+} CfgxVar;
+
+/* Set up by cfgExportInit(), NULL when nothing is exported */
+extern FILE *gCfgFile;
+
+void cfgExportInit(void);
+void cfgExportFin(void);
+
+#endif
@@ -0,0 +1,473 @@
+/*
+ * Offline solver. Maps a file written by cc1 with CS502_CFG_FILE set,
+ * rebuilds the CFG of every function in it and runs doDFA on it, so
+ * the solver can be tuned and checked without building cc1. Results
+ * go to stdout in output.txt format, CS502_DFA and CS502_TRACE work as
+ * they do in cc1.
+ *
+ * Build with "make cfgload", run as
+ *     ./cfgload cfg.bin [rounds]
+ * With rounds > 1 every function is solved that many times and only
+ * the first result is printed.
+ */
+#include <stdio.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "csproj2.h"
+#include "cfgexport.h"
+
+/* Everything rebuilt from one record, pointing into the mapped file */
+typedef struct LoadedFunc {
+	CFGNode *nodes;
+	CFGNode **succPool;
+	Operand *ops;
+	Variable *vars;
+	struct tree_node *decls;
+	struct tree_node *idents;
+	CFGNode *pEntry;
+	char *name;
+} LoadedFunc;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* 
+ * Hook up the successors so collectSucc() in dfa.c finds them again.
+ * Which field held an edge in cc1 does not matter to the solver.
+ */
+static void loadSuccs(CFGNode *ptr, CFGNode **succs, int num)
+{
+	switch (ptr->nType) {
+		case NTIF:
+			ptr->bTrue = num > 0 ? succs[0] : NULL;
+			ptr->bFalse = num > 1 ? succs[1] : NULL;
+			break;
+		case NTSWITCH:
+		case NTBIND:
+			if (num != 1 || ptr->nType == NTSWITCH) {
+				ptr->caseTable = succs;
+				ptr->caseNum = num;
+				break;
+			}
+			/* Fall through */
+		default:
+			ptr->next = num > 0 ? succs[0] : NULL;
+			break;
+	}
+}
+
+static Operand *loadOps(LoadedFunc *pFunc, int32_t *ops, int first, 
+	int num)
+{
+	Operand *pHead = NULL;
+	int i;
+
+	for (i=first+num-1; i>=first; i--) {
+		Operand *pOp = &pFunc->ops[i];
+
+		pOp->id = ops[i];
+		pOp->name = pFunc->vars[ops[i]].name;
+		pOp->next = pHead;
+		pHead = pOp;
+	}
+
+	return pHead;
+}
+
+/* Whether [off, off + num * elem) lies in a record of size bytes */
+static bool checkSection(uint32_t off, int32_t num, size_t elem,
+	uint32_t size)
+{
+	return num >= 0 && off >= sizeof(CfgxFunc) && off % 8 == 0 &&
+		off <= size && (uint64_t) num * elem <= size - off;
+}
+
+/* Whether off is -1 or starts a string ending inside the section */
+static bool checkString(char *str, uint32_t strLen, int32_t off)
+{
+	return off == -1 || (off >= 0 && (uint32_t) off < strLen && 
+		memchr(str + off, 0, strLen - off) != NULL);
+}
+
+/* 
+ * Check everything loadFunc() takes from a record: section bounds,
+ * ranges into the succ, op and decl sections, every node, variable
+ * and bind index, and the shape of the bind tree, which must number
+ * scopes in preorder, number the children of every bind densely
+ * and give every bind its own run of decls. Returns what is wrong,
+ * NULL for a good record.
+ */
+static const char *checkFunc(char *rec)
+{
+	CfgxFunc *pHead = (CfgxFunc *) rec;
+	uint32_t size = pHead->size;
+	CfgxNode *nodes;
+	int32_t *succs, *ops;
+	CfgxVar *vars;
+	CfgxBind *binds;
+	CfgxDecl *decls;
+	char *str;
+	uint32_t strLen;
+	const char *err = NULL;
+	int *childNum;
+	bool *seen;
+	int i, bindNodeNum = 0, declEnd = 0;
+
+	if (!checkSection(pHead->nodeOff, pHead->nodeNum, sizeof(CfgxNode), size) ||
+		!checkSection(pHead->succOff, pHead->edgeNum, sizeof(int32_t), size) ||
+		!checkSection(pHead->opOff, pHead->opNum, sizeof(int32_t), size) ||
+		!checkSection(pHead->varOff, pHead->varNum, sizeof(CfgxVar), size) ||
+		!checkSection(pHead->bindOff, pHead->bindNum, sizeof(CfgxBind), size) ||
+		!checkSection(pHead->declOff, pHead->declNum, sizeof(CfgxDecl), size) ||
+		!checkSection(pHead->strOff, 0, 1, size))
+		return "section out of the record";
+
+	nodes = (CfgxNode *) (rec + pHead->nodeOff);
+	succs = (int32_t *) (rec + pHead->succOff);
+	ops = (int32_t *) (rec + pHead->opOff);
+	vars = (CfgxVar *) (rec + pHead->varOff);
+	binds = (CfgxBind *) (rec + pHead->bindOff);
+	decls = (CfgxDecl *) (rec + pHead->declOff);
+	str = rec + pHead->strOff;
+	strLen = size - pHead->strOff;
+
+	if (pHead->name < 0 || !checkString(str, strLen, pHead->name))
+		return "bad function name";
+	if (pHead->entry < -1 || pHead->entry >= pHead->nodeNum)
+		return "bad entry node";
+
+	for (i=0; i<pHead->nodeNum; i++) {
+		CfgxNode *pRec = &nodes[i];
+
+		if (pRec->type < NTNORMAL || pRec->type > NTGOTO ||
+			!checkString(str, strLen, pRec->info))
+			return "bad node";
+		if (pRec->succFirst < 0 || pRec->succNum < 0 || 
+			pRec->succNum > pHead->edgeNum - pRec->succFirst ||
+			pRec->defFirst < 0 || pRec->defNum < 0 || 
+			pRec->defNum > pHead->opNum - pRec->defFirst ||
+			pRec->useFirst < 0 || pRec->useNum < 0 || 
+			pRec->useNum > pHead->opNum - pRec->useFirst)
+			return "node range out of its section";
+		if (pRec->type == NTBIND)
+			bindNodeNum++;
+	}
+
+	for (i=0; i<pHead->edgeNum; i++) {
+		if (succs[i] < 0 || succs[i] >= pHead->nodeNum)
+			return "bad successor";
+	}
+	for (i=0; i<pHead->opNum; i++) {
+		if (ops[i] < 0 || ops[i] >= pHead->varNum)
+			return "bad operand";
+	}
+	for (i=0; i<pHead->declNum; i++) {
+		if (!checkString(str, strLen, decls[i].name))
+			return "bad decl name";
+	}
+
+	/* initDFA() keeps one table slot per bind node */
+	if (bindNodeNum != pHead->bindNum)
+		return "bind count does not match the bind nodes";
+
+	seen = (bool *) xcalloc(pHead->nodeNum + pHead->bindNum + 1, sizeof(bool));
+	childNum = (int *) xcalloc(pHead->bindNum + 1, sizeof(int));
+
+	for (i=0; i<pHead->bindNum && !err; i++) {
+		CfgxBind *pRec = &binds[i];
+
+		if (pRec->node < 0 || pRec->node >= pHead->nodeNum || 
+			nodes[pRec->node].type != NTBIND || seen[pRec->node])
+			err = "bad bind node";
+		else if (pRec->parent < -1 || pRec->parent >= pHead->bindNum || 
+			pRec->parent == i)
+			err = "bad parent bind";
+		else if (pRec->scope < 0 || pRec->scope >= pHead->bindNum || 
+			seen[pHead->nodeNum + pRec->scope])
+			err = "bad scope id";
+		else if (pRec->declFirst < declEnd || pRec->declNum < 0 || 
+			pRec->declNum > pHead->declNum - pRec->declFirst)
+			err = "bind decls out of their section";
+		else {
+			declEnd = pRec->declFirst + pRec->declNum;
+			seen[pRec->node] = true;
+			seen[pHead->nodeNum + pRec->scope] = true;
+		}
+	}
+
+	/* Scopes are numbered in preorder, so a parent has the smaller one */
+	for (i=0; i<pHead->bindNum && !err; i++) {
+		CfgxBind *pRec = &binds[i];
+
+		if (pRec->parent < 0)
+			continue;
+		if (binds[pRec->parent].scope >= pRec->scope)
+			err = "bad parent bind";
+		childNum[pRec->parent]++;
+	}
+
+	/* Child indexes are 0 .. childNum - 1 under every bind, each once */
+	for (i=0; i<pHead->bindNum && !err; i++) {
+		CfgxBind *pRec = &binds[i];
+
+		if (pRec->parent < 0 ? pRec->child != 0 : 
+			pRec->child < 0 || pRec->child >= childNum[pRec->parent])
+			err = "bad child index";
+	}
+	if (!err) {
+		/* Reuse seen as one flag per (parent, child) pair */
+		int *childStart = (int *) xcalloc(pHead->bindNum + 1, sizeof(int));
+
+		memset(seen, 0, pHead->nodeNum + pHead->bindNum + 1);
+		for (i=0; i<pHead->bindNum; i++)
+			childStart[i + 1] = childStart[i] + childNum[i];
+		for (i=0; i<pHead->bindNum && !err; i++) {
+			CfgxBind *pRec = &binds[i];
+			int slot;
+
+			if (pRec->parent < 0)
+				continue;
+			slot = childStart[pRec->parent] + pRec->child;
+			if (seen[slot])
+				err = "bad child index";
+			seen[slot] = true;
+		}
+		free(childStart);
+	}
+
+	for (i=0; i<pHead->varNum && !err; i++) {
+		CfgxVar *pRec = &vars[i];
+
+		if (pRec->name < 0 || !checkString(str, strLen, pRec->name))
+			err = "bad variable name";
+		else if (pRec->bind < -1 || pRec->bind >= pHead->bindNum)
+			err = "bad variable bind";
+		else if (pRec->bind >= 0 && (pRec->decl < 0 || 
+			pRec->decl >= binds[pRec->bind].declNum))
+			err = "bad variable decl";
+		else if (pRec->bind >= 0) {
+			/* finDFA() prints the name of the decl */
+			CfgxDecl *pDecl = 
+				&decls[binds[pRec->bind].declFirst + pRec->decl];
+
+			if (!pDecl->isVar || pDecl->name < 0)
+				err = "variable decl is not a named VAR_DECL";
+		}
+	}
+
+	free(seen);
+	free(childNum);
+
+	return err;
+}
+
+static void loadFunc(AnalysisCtx *pCtx, LoadedFunc *pFunc, char *rec)
+{
+	CfgxFunc *pHead = (CfgxFunc *) rec;
+	CfgxNode *nodes = (CfgxNode *) (rec + pHead->nodeOff);
+	int32_t *succs = (int32_t *) (rec + pHead->succOff);
+	int32_t *ops = (int32_t *) (rec + pHead->opOff);
+	CfgxVar *vars = (CfgxVar *) (rec + pHead->varOff);
+	CfgxBind *binds = (CfgxBind *) (rec + pHead->bindOff);
+	CfgxDecl *decls = (CfgxDecl *) (rec + pHead->declOff);
+	char *str = rec + pHead->strOff;
+	int i, j;
+
+#define STR(off)	((off) < 0 ? NULL : str + (off))
+
+	memset(pFunc, 0, sizeof(LoadedFunc));
+	pFunc->name = STR(pHead->name);
+	pFunc->nodes = (CFGNode *) xcalloc(pHead->nodeNum + 1, sizeof(CFGNode));
+	pFunc->ops = (Operand *) xcalloc(pHead->opNum + 1, sizeof(Operand));
+	pFunc->vars = (Variable *) xcalloc(pHead->varNum + 1, sizeof(Variable));
+	pFunc->decls = (struct tree_node *) 
+		xcalloc(pHead->declNum + 1, sizeof(struct tree_node));
+	pFunc->idents = (struct tree_node *) 
+		xcalloc(pHead->declNum + 1, sizeof(struct tree_node));
+	pFunc->succPool = 
+		(CFGNode **) xmalloc(sizeof(CFGNode *) * (pHead->edgeNum + 1));
+
+	pCtx->varNum = pHead->varNum;
+	pCtx->varList = (Variable **) 
+		xrealloc(pCtx->varList, sizeof(Variable *) * (pHead->varNum + 1));
+	for (i=0; i<pHead->varNum; i++) {
+		pFunc->vars[i].name = STR(vars[i].name);
+		pFunc->vars[i].id = i;
+		pCtx->varList[i] = &pFunc->vars[i];
+	}
+
+	for (i=0; i<pHead->edgeNum; i++)
+		pFunc->succPool[i] = &pFunc->nodes[succs[i]];
+
+	/* Nodes are stored in cfgList order */
+	for (i=0; i<pHead->nodeNum; i++) {
+		CFGNode *ptr = &pFunc->nodes[i];
+		CfgxNode *pRec = &nodes[i];
+
+		ptr->nType = (NodeType) pRec->type;
+		ptr->info = STR(pRec->info);
+		ptr->nextCFG = i + 1 < pHead->nodeNum ? ptr + 1 : NULL;
+		ptr->defOp = loadOps(pFunc, ops, pRec->defFirst, pRec->defNum);
+		ptr->useOp = loadOps(pFunc, ops, pRec->useFirst, pRec->useNum);
+		loadSuccs(ptr, pFunc->succPool + pRec->succFirst, pRec->succNum);
+	}
+
+	for (i=0; i<pHead->bindNum; i++) {
+		CfgxBind *pRec = &binds[i];
+		CFGNode *pBind = &pFunc->nodes[pRec->node];
+		tree pPrev = NULL;
+
+		pBind->scopeId = pRec->scope;
+		pBind->childIdx = pRec->child;
+		pBind->parentBind = pRec->parent < 0 ? NULL : 
+			&pFunc->nodes[binds[pRec->parent].node];
+		if (pBind->parentBind)
+			pBind->parentBind->childNum++;
+
+		for (j=pRec->declFirst; j<pRec->declFirst+pRec->declNum; j++) {
+			tree decl = &pFunc->decls[j];
+			tree ident = &pFunc->idents[j];
+
+			decl->code = decls[j].isVar ? VAR_DECL : TYPE_DECL;
+			ident->code = IDENTIFIER_NODE;
+			ident->ident = STR(decls[j].name);
+			decl->name = decls[j].name < 0 ? NULL : ident;
+
+			if (pPrev)
+				pPrev->chain = decl;
+			else
+				pBind->decls = decl;
+			pPrev = decl;
+		}
+	}
+
+	for (i=0; i<pHead->varNum; i++) {
+		Variable *pVar = &pFunc->vars[i];
+
+		if (vars[i].bind < 0)
+			continue;
+
+		pVar->pBind = &pFunc->nodes[binds[vars[i].bind].node];
+		pVar->decl = &pFunc->decls[binds[vars[i].bind].declFirst + 
+			vars[i].decl];
+		pVar->declIdx = vars[i].decl;
+	}
+
+#undef STR
+
+	pCtx->cfgList = pHead->nodeNum ? pFunc->nodes : NULL;
+	pCtx->numCFGNode = pHead->nodeNum;
+	pCtx->numBindNode = pCtx->scopeNum = pHead->bindNum;
+	pFunc->pEntry = pHead->entry < 0 ? NULL : &pFunc->nodes[pHead->entry];
+}
+
+static void freeFunc(LoadedFunc *pFunc)
+{
+	free(pFunc->nodes);
+	free(pFunc->succPool);
+	free(pFunc->ops);
+	free(pFunc->vars);
+	free(pFunc->decls);
+	free(pFunc->idents);
+}
+
+int main(int argc, char **argv)
+{
+	int rounds = argc > 2 ? atoi(argv[2]) : 1;
+	FILE *devNull = fopen("/dev/null", "w");
+	AnalysisCtx *pCtx;
+	struct stat st;
+	double solveTime = 0;
+	int funcNum = 0, nodeNum = 0;
+	size_t off;
+	char *pMap;
+	int fd, r;
+
+	if (argc < 2 || rounds <= 0) {
+		fprintf(stderr, "usage: %s cfg.bin [rounds]\n", argv[0]);
+		return 1;
+	}
+
+	fd = open(argv[1], O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		fprintf(stderr, "cannot open %s\n", argv[1]);
+		return 1;
+	}
+
+	/* Private and writable so strings can be handed out as char * */
+	pMap = st.st_size ? (char *) mmap(NULL, st.st_size, 
+		PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : NULL;
+	close(fd);
+	if (pMap == MAP_FAILED) {
+		fprintf(stderr, "cannot map %s\n", argv[1]);
+		return 1;
+	}
+
+	traceInit();
+	dfaEngineInit();
+	dfaOutputInit();
+
+	pCtx = (AnalysisCtx *) xcalloc(1, sizeof(AnalysisCtx));
+	pCtx->traceFile = gTraceFile;
+	pCtx->perf.missFd = pCtx->perf.refFd = -1;
+	if (TRACE_ON(TRACE_CFG))
+		perfOpen(&pCtx->perf);
+
+	for (off=0; off + sizeof(CfgxFunc) <= (size_t) st.st_size; ) {
+		CfgxFunc *pHead = (CfgxFunc *) (pMap + off);
+		LoadedFunc func;
+		const char *err = NULL;
+
+		if (pHead->magic == CFGX_MAGIC_SWAPPED)
+			err = "written with the other byte order";
+		else if (pHead->magic != CFGX_MAGIC || pHead->version != CFGX_VERSION)
+			err = "bad magic or version";
+		else if (pHead->size < sizeof(CfgxFunc) || pHead->size % 8 != 0 ||
+			off + pHead->size > (size_t) st.st_size) 
+			err = "bad record size";
+		else
+			err = checkFunc(pMap + off);
+
+		if (err) {
+			fprintf(stderr, "%s: bad record at offset %lu: %s\n", argv[1], 
+				(unsigned long) off, err);
+			return 1;
+		}
+
+		loadFunc(pCtx, &func, pMap + off);
+
+		for (r=0; r<rounds; r++) {
+			double t0 = now();
+
+			doDFA(pCtx, r ? devNull : stdout, func.pEntry, func.name);
+			solveTime += now() - t0;
+			freeDFA(pCtx);
+		}
+
+		funcNum++;
+		nodeNum += pHead->nodeNum;
+		freeFunc(&func);
+		off += pHead->size;
+	}
+
+	fprintf(stderr, "%d functions, %d nodes, doDFA %.3f ms per round\n", 
+		funcNum, nodeNum, solveTime * 1e3 / rounds);
+
+	freeDFAScratch(pCtx);
+	perfClose(&pCtx->perf);
+	free(pCtx->varList);
+	free(pCtx);
+	fclose(devNull);
+	traceFin();
+
+	return 0;
+}
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <assert.h>
+#include <pthread.h>
 #include "csproj2.h"
 #include "config.h"
 #include "system.h"
@@ -11,224 +12,160 @@
 #include "tree-iterator.h"
 #include "pretty-print.h"
 #include "hashtable.h"
+#include "cfgexport.h"
 
 extern GTY(()) struct cgraph_node *cgraph_nodes;
 
-/* The list of switch information */
-SwitchData *pSwitchList = NULL;
-/* The table to keep track of label node */
-CFGNode *labelTable[MAX_LABEL_SIZE];
-int labelNum;
-/* The table to keep track of goto node */
-CFGNode *gotoTable[MAX_LABEL_SIZE];
-int gotoNum;
-/* Recording number of bind nodes */
-int numBindNode;
-/* Recording number of live CFGNodes */
-int numCFGNode;
-/* The list of all CFGNodes */
-CFGNode *cfgList;
-/* The hash table for storing variables */
-HashTable *gVarTable;
-/* Temporary buffer */
-char tmpBuf[4096] = {0};
-
-static unsigned int auxTable[] = {
-	0x67452301,
-	0xEFCDAB89,
-	0x547B7452,
-	0x98BADCFE,
-	0x10325476,
-	0xC3D2E1F0,
-	0xA6C3D452,
-	0xDAEFCDB7,
-};
-
-static unsigned int hashing(char *name)
-{
-	char *ptr;
-	unsigned int hashVal;
-	int i;
+/* 
+ * print_c_tree() keeps its pretty printer in a function-static and
+ * sets it up on first use, so traces from several workers go through
+ * it one at a time.
+ */
+static pthread_mutex_t gPrintLock = PTHREAD_MUTEX_INITIALIZER;
 
-	for (hashVal=0, ptr=name; *ptr; ptr++)
-		hashVal += *ptr;
+CFGNode *newCFGNode(AnalysisCtx *pCtx, char *info, NodeType type)
+{
+	CFGNode *pNode = (CFGNode *) arenaAlloc(&pCtx->arena, sizeof(CFGNode));
+	memset(pNode, 0, sizeof(CFGNode));
 
-	for (i=0, ptr=name; *ptr; ptr++, i=(i+1) % 7)
-		hashVal += *ptr * auxTable[i];
+	pNode->info = arenaStrdup(&pCtx->arena, info);
+	pNode->nType = type;
 
-	return hashVal;
-}
+	/* Case branch table of a switch is created by the first case */
+	if (type == NTBIND)
+		pCtx->numBindNode++;
 
-static void delData(void *data)
-{
-	char *ptr = (char *)data;
+	/* Add the live count of CFGNodes and add it to dfa list */
+	pCtx->numCFGNode++;
+	if (pCtx->cfgList)
+		pNode->nextCFG = pCtx->cfgList;
+	pCtx->cfgList = pNode;
 
-	free(ptr);
+	return pNode;
 }
 
-static bool cmpEqual(void *a, void *b)
+/* 
+ * Append a branch to the case table of a switch. The table lives in
+ * the arena and doubles when full, so its size follows the real
+ * number of cases.
+ */
+void addCase(AnalysisCtx *pCtx, CFGNode *pSwitch, CFGNode *pCase)
 {
-	char *pStrA = ((char *)a);
-	char *pStrB = ((char *)b);
+	if (pSwitch->caseNum == pSwitch->caseCap) {
+		CFGNode **pNew;
 
-	if (strcmp(pStrA, pStrB)) {
-		return false;
-	} else
-		return true;
-}
+		pSwitch->caseCap = pSwitch->caseCap ? pSwitch->caseCap << 1 : 4;
+		pNew = (CFGNode **) arenaAlloc(&pCtx->arena, 
+			sizeof(CFGNode *) * pSwitch->caseCap);
 
-/* Helper function to free an operand */
-void freeOperand(Operand *pOp, bool isList)
-{
-	if (!isList)
-		free(pOp);
-	else {
-		Operand *ptr;
+		if (pSwitch->caseNum)
+			memcpy(pNew, pSwitch->caseTable, 
+				sizeof(CFGNode *) * pSwitch->caseNum);
 
-		while (pOp) {
-			ptr = pOp;
-			pOp = pOp->next;
-			free(ptr);
-		}
+		pSwitch->caseTable = pNew;
 	}
+
+	pSwitch->caseTable[pSwitch->caseNum++] = pCase;
 }
 
-/* Helper function to free a CFGNode */
-void freeCFGNode(CFGNode *pCFG)
+/* 
+ * Find the scoped variable of an operand used in pBind, and intern it.
+ * A VAR_DECL is looked for by identity in the binds around pBind, so
+ * the result does not depend on where the first reference is. Other
+ * decls are matched by name. The variable remembers the declaring
+ * bind and the decl index.
+ */
+static Variable *internVariable(AnalysisCtx *pCtx, tree node, 
+	CFGNode *pBind)
 {
-	/* Decrease live CFGNode number and delete it from cfgList */
-	numCFGNode--;
-	if (cfgList == pCFG)
-		cfgList = cfgList->nextCFG;
-	else {
-		CFGNode *ptr = cfgList;
+	char *name = IDENTIFIER_POINTER(DECL_NAME(node));
+	bool isVar = TREE_CODE(node) == VAR_DECL;
+	tree decl = NULL;
+	int i = -1;
 
-		while (ptr->nextCFG != pCFG && ptr->nextCFG) {
-			ptr = ptr->nextCFG;
+	/* Variable renaming */
+	while (pBind) {
+		for (i=0, decl=pBind->decls; decl; decl=DECL_CHAIN(decl), i++) {
+			if (isVar ? decl == node : TREE_CODE(decl) == VAR_DECL && 
+				strcmp(IDENTIFIER_POINTER(DECL_NAME(decl)), name) == 0)
+				goto done;
 		}
-
-		assert(ptr->nextCFG);
-
-		ptr->nextCFG = pCFG->nextCFG;
-	}
-
-	/* Delete node */
-	switch (pCFG->nType) {
-		case NTSWITCH:
-			/* Switch may has bind */
-			if (pCFG->caseTable)
-				free(pCFG->caseTable);
-			break;
-		case NTBIND:
-			/* Bind may be in a switch */
-			if (pCFG->caseTable)
-				free(pCFG->caseTable);
-			numBindNode--;
-			break;
+		pBind = pBind->parentBind;
 	}
+	decl = NULL;
+	i = -1;
+done:
 
-	/* Free its information */
-	free(pCFG->info);
-
-	/* Free all operands */
-	if (pCFG->defOp)
-		freeOperand(pCFG->defOp, true);
-	if (pCFG->useOp)
-		freeOperand(pCFG->useOp, true);
-	if (pCFG->in)
-		freeOperand(pCFG->in, true);
-	if (pCFG->out)
-		freeOperand(pCFG->out, true);
-
-	/* Final free */
-	free(pCFG);
+	return internVar(pCtx, name, pBind, decl, i);
 }
 
-CFGNode *newCFGNode(char *info, NodeType type)
+static bool cmpDecl(void *a, void *b)
 {
-	CFGNode *pNode = (CFGNode *) xmalloc(sizeof(CFGNode));
-	memset(pNode, 0, sizeof(CFGNode));
-
-	pNode->info = xstrdup(info);
-	pNode->nType = type;
-
-	/* Create case branch table for it */
-	switch (type) {
-		case NTSWITCH:
-			pNode->caseTable = 
-				(CFGNode **) xmalloc(sizeof(CFGNode *) * MAX_CASE_NUM);
-			memset(pNode->caseTable, 0, sizeof(CFGNode *) * MAX_CASE_NUM);
-			pNode->caseNum = 0;
-			break;
-		case NTBIND:
-			numBindNode++;
-			break;
-	}
-
-	/* Add the live count of CFGNodes and add it to dfa list */
-	numCFGNode++;
-	if (cfgList)
-		pNode->nextCFG = cfgList;
-	cfgList = pNode;
-
-	return pNode;
+	return ((DeclEntry *)a)->decl == ((DeclEntry *)b)->decl;
 }
 
-Operand *newOperand(char *name, CFGNode *pBind)
+static unsigned int hashDecl(tree decl)
 {
-	Operand *pOp = (Operand *) xmalloc(sizeof(Operand));
-	char *pName;
-	int len;
-
-	len = sprintf(tmpBuf, "%s", name);
-
-	/* Variable renaming */
-	while (pBind) {
-		tree decl = pBind->decls;
-		int i;
+	unsigned long val = (unsigned long) decl >> 4;
 
-		for (i=0; decl; decl=DECL_CHAIN(decl), i++) {
-			if (TREE_CODE(decl) == VAR_DECL) {
-				char *pName = IDENTIFIER_POINTER((DECL_NAME(decl)));
-				if (strcmp(pName, tmpBuf) == 0) {
-					sprintf(tmpBuf+len, "%s-%d", pBind->bindID, i);
-					goto done;
-				}
-			}
-		}
-		pBind = pBind->parentBind;
-	}
-done:
+	val *= 0x9E3779B97F4A7C15UL;
 
-	pName = hashLookupTable(gVarTable, hashing(tmpBuf), cmpEqual, tmpBuf, false);
+	return (unsigned int) (val >> 32);
+}
 
-	if (!pName) {
-		pName = hashLookupTable(gVarTable, hashing(tmpBuf), 
-			cmpEqual, xstrdup(tmpBuf), true);
+/* 
+ * Create an operand for a VAR_DECL or PARM_DECL. A decl always
+ * resolves to the same scoped variable, so it is looked up by its
+ * tree pointer first and only renamed and interned by name once.
+ */
+Operand *newOperand(AnalysisCtx *pCtx, tree decl, CFGNode *pBind)
+{
+	Operand *pOp = (Operand *) arenaAlloc(&pCtx->arena, sizeof(Operand));
+	DeclEntry key, *pEntry;
+	double mark = 0;
+
+	if (STATS_ON())
+		mark = statsNow();
+
+	key.decl = decl;
+	pEntry = hashLookupTable(pCtx->declTable, hashDecl(decl), 
+		cmpDecl, &key, false);
+
+	if (!pEntry) {
+		pEntry = (DeclEntry *) arenaAlloc(&pCtx->arena, sizeof(DeclEntry));
+		pEntry->decl = decl;
+		pEntry->pVar = internVariable(pCtx, decl, pBind);
+		hashLookupTable(pCtx->declTable, hashDecl(decl), 
+			cmpDecl, pEntry, true);
 	}
 
-	pOp->name = pName;
+	pOp->name = pEntry->pVar->name;
+	pOp->id = pEntry->pVar->id;
 	pOp->next = NULL;
 
+	if (STATS_ON())
+		statsLap(&pCtx->stats, PHASE_INTERN, &mark);
+
 	return pOp;
 }
 
-void freeSwitchData()
+void freeSwitchData(AnalysisCtx *pCtx)
 {
 	SwitchData *pHead;
 	CFGNode **pCaseTable;
 	int *pCaseNum;
 
-	assert(pSwitchList);
+	assert(pCtx->pSwitchList);
 	
-	pHead = pSwitchList;
+	pHead = pCtx->pSwitchList;
 
-	pSwitchList = pSwitchList->next;
+	pCtx->pSwitchList = pCtx->pSwitchList->next;
 
 	free(pHead);
 }
 
-void newSwitchData(CFGNode *pEntry, CFGNode *pExit, unsigned int exitID)
+void newSwitchData(AnalysisCtx *pCtx, CFGNode *pEntry, CFGNode *pExit, 
+	unsigned int exitID)
 {
 	SwitchData *pNew;
 
@@ -239,59 +176,114 @@ void newSwitchData(CFGNode *pEntry, CFGNode *pExit, unsigned int exitID)
 	pNew->switchExit = pExit;
 	pNew->exitID = exitID;
 
-	if (pSwitchList)
-		pNew->next = pSwitchList;
+	if (pCtx->pSwitchList)
+		pNew->next = pCtx->pSwitchList;
 
-	pSwitchList = pNew;
+	pCtx->pSwitchList = pNew;
 }
 
-void handleGoto(CFGNode *pGoto)
+static bool cmpLabel(void *a, void *b)
 {
-	int i;
+	return ((LabelEntry *)a)->labelID == ((LabelEntry *)b)->labelID;
+}
+
+static unsigned int hashLabel(unsigned int labelID)
+{
+	unsigned int hashVal = labelID * 0x9E3779B1;
+
+	return hashVal ^ (hashVal >> 16);
+}
+
+/* Find the label table entry of a DECL_UID, create it if needed */
+static LabelEntry *getLabelEntry(AnalysisCtx *pCtx, unsigned int labelID)
+{
+	LabelEntry key, *pEntry;
+
+	key.labelID = labelID;
+	pEntry = hashLookupTable(pCtx->labelTable, hashLabel(labelID), 
+		cmpLabel, &key, false);
+
+	if (!pEntry) {
+		pEntry = (LabelEntry *) arenaAlloc(&pCtx->arena, sizeof(LabelEntry));
+		pEntry->labelID = labelID;
+		pEntry->pLabel = NULL;
+		pEntry->gotoList = NULL;
+		hashLookupTable(pCtx->labelTable, hashLabel(labelID), 
+			cmpLabel, pEntry, true);
+	}
+
+	return pEntry;
+}
+
+void handleGoto(AnalysisCtx *pCtx, CFGNode *pGoto)
+{
+	LabelEntry *pEntry = getLabelEntry(pCtx, pGoto->labelID);
 
 	/* Check for any label it can go */
-	for (i=0; i<labelNum; i++) {
-		if (pGoto->labelID == labelTable[i]->labelID) {
-			pGoto->next = labelTable[i];
-			return;
-		}
+	if (pEntry->pLabel) {
+		pGoto->next = pEntry->pLabel;
+		return;
 	}
 
-	/* Put it in goto table for later handling */
-	gotoTable[gotoNum++] = pGoto;
+	/* Wait for the label for later handling */
+	pGoto->nextGoto = pEntry->gotoList;
+	pEntry->gotoList = pGoto;
 }
 
-void handleLabel(CFGNode *pLabel)
+void handleLabel(AnalysisCtx *pCtx, CFGNode *pLabel)
 {
-	int i;
+	LabelEntry *pEntry = getLabelEntry(pCtx, pLabel->labelID);
+	CFGNode *pGoto;
 
-	labelTable[labelNum++] = pLabel;
+	if (!pEntry->pLabel)
+		pEntry->pLabel = pLabel;
 
 	/* Handle any un-handled goto */
-	for (i=0; i<gotoNum; i++) {
-		if (gotoTable[i]->labelID == pLabel->labelID) {
-			
-			gotoTable[i]->next = pLabel;
-			gotoTable[i] = gotoTable[--gotoNum];
-			i--;
-		}
+	for (pGoto=pEntry->gotoList; pGoto; pGoto=pGoto->nextGoto)
+		pGoto->next = pLabel;
+
+	pEntry->gotoList = NULL;
+}
+
+/* Print a variable under its scoped name, like "x#0#1-2" */
+static void dumpVar(FILE *file, Variable *pVar)
+{
+	fputs(pVar->name, file);
+
+	if (pVar->pBind) {
+		printScope(file, pVar->pBind);
+		fprintf(file, "-%d", pVar->declIdx);
 	}
 }
 
-void dumpOperands(Operand *pOp)
+void dumpOperands(AnalysisCtx *pCtx, FILE *file, Operand *pOp)
 {
-	printf("%s", pOp->name);
+	dumpVar(file, pCtx->varList[pOp->id]);
 	pOp = pOp->next;
 
 	for (;pOp; pOp=pOp->next) {
-		printf(" %s", pOp->name);
+		fprintf(file, " ");
+		dumpVar(file, pCtx->varList[pOp->id]);
+	}
+}
+
+void dumpSet(AnalysisCtx *pCtx, BitWord *set)
+{
+	int i = bitNextAnd(set, NULL, pCtx->setWords, 0);
+
+	dumpVar(pCtx->traceFile, pCtx->varList[i]);
+
+	while ((i = bitNextAnd(set, NULL, pCtx->setWords, i + 1)) >= 0) {
+		fprintf(pCtx->traceFile, " ");
+		dumpVar(pCtx->traceFile, pCtx->varList[i]);
 	}
 }
 
 /*
  * Insert an operand to a CFGNode. Before insertion, we
  * have to check whether there exists the same operand.
- * If it is, do not insert, free it, and return.
+ * If it is, do not insert, and return. The operand is
+ * left in the arena.
  */
 void insertOperand(CFGNode *pCFG, Operand *pOp, ActionType type)
 {
@@ -312,283 +304,383 @@ void insertOperand(CFGNode *pCFG, Operand *pOp, ActionType type)
 	}
 
 	/* Compare first operand */
-	if (pOp->name == ptr->name) {
-		freeOperand(pOp, false);
+	if (pOp->id == ptr->id)
 		return;
-	}
 
 	while (ptr->next) {
-		if (pOp->name == ptr->name) {
-			freeOperand(pOp, false);
+		if (pOp->id == ptr->id)
 			return;
-		}
 		ptr = ptr->next;
 	}
 
 	ptr->next = pOp;	
 }
 
-void setupBind(CFGNode *curBind, CFGNode *parentBind)
+/* 
+ * Number a new scope. Binds are met in preorder, so are the ids. The
+ * textual id of a scope, "#0#2#1", is the path of child indexes from
+ * the root and only printed, see printScope().
+ */
+void setupBind(AnalysisCtx *pCtx, CFGNode *curBind, CFGNode *parentBind)
 {
+	curBind->scopeId = pCtx->scopeNum++;
+
 	if (parentBind == NULL) { /* Root bind */
-		curBind->bindID = xstrdup("#0");
+		curBind->childIdx = 0;
 	} else {
-		sprintf(tmpBuf, "%s#%d", 
-			parentBind->bindID, parentBind->childNum++);
+		curBind->childIdx = parentBind->childNum++;
 		curBind->parentBind = parentBind;
-		curBind->bindID = xstrdup(tmpBuf);
 	}
 }
 
-void dumpCFG(CFGNode *ptr)
+static void dumpNode(AnalysisCtx *pCtx, CFGNode *ptr)
 {
-	if (!ptr)
-		return;
-
-	if (ptr->dumped) {
-		printf("[0x%x] dumped\n", ptr);
-		return;
-	}
-
+	FILE *file = pCtx->traceFile;
 	int i;
 
-	ptr->dumped = true;
-
-	printf("[0x%x][%s", ptr, ptr->info);
+	fprintf(file, "[0x%x][%s", ptr, ptr->info);
 
 	for (i=13-strlen(ptr->info); i>0; i--) {
-		printf(" ");
+		fprintf(file, " ");
 	}
-	printf("]");
+	fprintf(file, "]");
+
+	if (ptr->loopDepth)
+		fprintf(file, "[LOOP:%d]", ptr->loopDepth);
 
 	if (ptr->defOp) {
-		printf("[DEF:");
-		dumpOperands(ptr->defOp);
-		printf("]");
+		fprintf(file, "[DEF:");
+		dumpOperands(pCtx, file, ptr->defOp);
+		fprintf(file, "]");
 	}
 	if (ptr->useOp) {
-		printf("[USE:");
-		dumpOperands(ptr->useOp);
-		printf("]");
+		fprintf(file, "[USE:");
+		dumpOperands(pCtx, file, ptr->useOp);
+		fprintf(file, "]");
 	}
 
-	if (ptr->in) {
-		printf("[IN:");
-		dumpOperands(ptr->in);
-		printf("]");
+	if (ptr->in && !bitEmpty(ptr->in, pCtx->setWords)) {
+		fprintf(file, "[IN:");
+		dumpSet(pCtx, ptr->in);
+		fprintf(file, "]");
 	}
 
-	if (ptr->out) {
-		printf("[OUT:");
-		dumpOperands(ptr->out);
-		printf("]");
+	if (ptr->out && !bitEmpty(ptr->out, pCtx->setWords)) {
+		fprintf(file, "[OUT:");
+		dumpSet(pCtx, ptr->out);
+		fprintf(file, "]");
 	}
 
-	printf("\n");
+	fprintf(file, "\n");
+}
+
+/* 
+ * Dump the CFG depth first from ptr. Successors are pushed on an
+ * explicit stack in reverse, so the order is the same as walking
+ * them recursively one after another.
+ */
+void dumpCFG(AnalysisCtx *pCtx, CFGNode *ptr)
+{
+	CFGNode **stack;
+	int top = 0, cap = 256;
 
-	if (ptr->nType == NTIF) {
-		dumpCFG(ptr->bTrue);
-		dumpCFG(ptr->bFalse);
-	} else if (ptr->nType == NTSWITCH) {
+	stack = (CFGNode **) xmalloc(sizeof(CFGNode *) * cap);
+	stack[top++] = ptr;
+
+	while (top) {
 		int i;
 
-		dumpCFG(ptr->next);
-		for (i=0; i<ptr->caseNum; i++) {
-			dumpCFG(ptr->caseTable[i]);
+		ptr = stack[--top];
+
+		if (!ptr)
+			continue;
+
+		if (ptr->dumped) {
+			fprintf(pCtx->traceFile, "[0x%x] dumped\n", ptr);
+			continue;
+		}
+
+		ptr->dumped = true;
+		dumpNode(pCtx, ptr);
+
+		if (top + ptr->caseNum + 2 > cap) {
+			while (top + ptr->caseNum + 2 > cap)
+				cap <<= 1;
+			stack = (CFGNode **) xrealloc(stack, sizeof(CFGNode *) * cap);
+		}
+
+		if (ptr->nType == NTIF) {
+			stack[top++] = ptr->bFalse;
+			stack[top++] = ptr->bTrue;
+		} else if (ptr->nType == NTSWITCH) {
+			for (i=ptr->caseNum-1; i>=0; i--) {
+				stack[top++] = ptr->caseTable[i];
+			}
+			stack[top++] = ptr->next;
+		} else {
+			stack[top++] = ptr->next;
 		}
-	} else {
-		dumpCFG(ptr->next);
 	}
+
+	free(stack);
 }
 
-CFGNode* walkStmt(tree node, tree nextNode, CFGNode *pPrev, 
-	ActionType type, CFGNode *pBind)
+/* 
+ * Push a walkStmt call. NOP_EXPR and ADDR_EXPR only wrap the tree
+ * that matters, so they are looked through right away.
+ */
+static void walkPush(AnalysisCtx *pCtx, tree node, tree nextNode, 
+	CFGNode *pPrev, ActionType type, CFGNode *pBind)
 {
-	CFGNode *pRet = NULL;
+	WalkFrame *pFrame;
+
+	if (TRACE_ON(TRACE_NODE))
+		fprintf(pCtx->traceFile, "%s %x\n", TREE_NAME(node), pBind);
+
+	while (TREE_CODE(node) == NOP_EXPR || TREE_CODE(node) == ADDR_EXPR)
+		node = TREE_OPERAND(node, 0);
+
+	if (pCtx->walkTop == pCtx->walkCap) {
+		pCtx->walkCap = pCtx->walkCap ? pCtx->walkCap << 1 : 256;
+		pCtx->walkStack = 
+			(WalkFrame *) xrealloc(pCtx->walkStack, 
+				sizeof(WalkFrame) * pCtx->walkCap);
+	}
+
+	pFrame = &pCtx->walkStack[pCtx->walkTop++];
+	pFrame->node = node;
+	pFrame->nextNode = nextNode;
+	pFrame->pPrev = pPrev;
+	pFrame->type = type;
+	pFrame->pBind = pBind;
+	pFrame->step = 0;
+}
+
+/* 
+ * Walk a child tree and resume this frame at nextStep with what the
+ * child returned. Pushing may move the stack, so the frame must not
+ * be touched after this.
+ */
+#define WALK_CHILD(nextStep, node, nextNode, pPrev, type, pBind)		\
+	do {															\
+		pFrame->step = (nextStep);									\
+		walkPush(pCtx, node, nextNode, pPrev, type, pBind);			\
+		return false;												\
+	} while (0)
+
+#define WALK_RETURN(pNode)	\
+	do {					\
+		*ppRet = (pNode);	\
+		return true;		\
+	} while (0)
+
+/*
+ * Run the top frame until it pushes a child or finishes. pChild is
+ * what the last finished child returned. Return true and set *ppRet
+ * when the frame is done.
+ */
+static bool walkStep(AnalysisCtx *pCtx, WalkFrame *pFrame, CFGNode *pChild,
+	CFGNode **ppRet)
+{
+	tree node = pFrame->node;
+	CFGNode *pPrev = pFrame->pPrev;
+	ActionType type = pFrame->type;
+	CFGNode *pBind = pFrame->pBind;
 
-	printf("%s %x\n", TREE_NAME(node), pBind);
-try:
 	switch (TREE_CODE(node)) {
 		case STATEMENT_LIST:
-			{
-				tree_stmt_iterator i;
-				CFGNode *pCur = pPrev;
-
-				for (i=tsi_start(node); !tsi_end_p (i); tsi_next (&i)) {
-					tree stmt = tsi_stmt(i);
-					tree nextStmt;
+			if (pFrame->step == 0) {
+				pFrame->iter = tsi_start(node);
+				pFrame->pCur = pPrev;
+			} else {
+				pFrame->pCur = pChild;
+				tsi_next(&pFrame->iter);
+			}
 
-					if (i.ptr->next)
-						nextStmt = i.ptr->next->stmt;
+			if (!tsi_end_p(pFrame->iter)) {
+				tree_stmt_iterator i = pFrame->iter;
+				tree nextStmt = NULL;
 
-					pCur = 
-						walkStmt(stmt, nextStmt, pCur, ATCFG, pBind);
-				}
+				if (i.ptr->next)
+					nextStmt = i.ptr->next->stmt;
 
-				pRet = pCur;
+				WALK_CHILD(1, tsi_stmt(i), nextStmt, 
+					pFrame->pCur, ATCFG, pBind);
 			}
-			break;
-		case NOP_EXPR:
-		case ADDR_EXPR:
-			node = TREE_OPERAND(node, 0);
-			goto try;
+
+			WALK_RETURN(pFrame->pCur);
 		case BIND_EXPR:
-			{
-				CFGNode *pHead = newCFGNode("BIND", NTBIND);
-				CFGNode *pTail = newCFGNode("BIND_END", NTNORMAL);
-				CFGNode *pLastExpr;
+			if (pFrame->step == 0) {
+				CFGNode *pHead = newCFGNode(pCtx, "BIND", NTBIND);
+
+				pFrame->pEnd = newCFGNode(pCtx, "BIND_END", NTNORMAL);
 
 				if (pPrev->nType != NTGOTO)
 					pPrev->next = pHead;
 		
 				if (pPrev->nType == NTSWITCH) {
-					pSwitchList->pBind = pHead;
+					pCtx->pSwitchList->pBind = pHead;
 				}
 
 				/* Get the declaration tree directly */
 				pHead->decls = BIND_EXPR_VARS(node);
 
 				/* Handling bind expression*/
-				setupBind(pHead, pBind);
+				setupBind(pCtx, pHead, pBind);
 
-				pLastExpr = 
-					walkStmt(BIND_EXPR_BODY(node), NULL, pHead, ATCFG, pHead);
+				WALK_CHILD(1, BIND_EXPR_BODY(node), NULL, pHead, ATCFG, pHead);
+			}
 
-				if (pLastExpr->nType != NTGOTO)
-					pLastExpr->next = pTail;
+			/* pChild is the last expression of the body */
+			if (pChild->nType != NTGOTO)
+				pChild->next = pFrame->pEnd;
 				
-				pRet = pTail;
-			}
-			break;
+			WALK_RETURN(pFrame->pEnd);
 		case DECL_EXPR:
 			{
 				tree declNode = DECL_EXPR_DECL(node);
 				
-				/* Only handle initialized variables */
-				if (DECL_INITIAL(declNode)) {
-					CFGNode *pCur = newCFGNode(TREE_NAME(node), NTNORMAL);
-					
-					pPrev->next = pCur;
+				switch (pFrame->step) {
+				case 0:
+					/* Only handle initialized variables */
+					if (!DECL_INITIAL(declNode))
+						WALK_RETURN(pPrev);
+
+					pFrame->pCur = newCFGNode(pCtx, TREE_NAME(node), NTNORMAL);
+					pPrev->next = pFrame->pCur;
 			
-					walkStmt(declNode, NULL, pCur, ATLHS, pBind);
-					walkStmt(DECL_INITIAL(declNode), 
-						NULL, pCur, ATRHS, pBind);
-
-					pRet = pCur;
-				} else
-					pRet = pPrev;
+					WALK_CHILD(1, declNode, NULL, pFrame->pCur, ATLHS, pBind);
+				case 1:
+					WALK_CHILD(2, DECL_INITIAL(declNode), 
+						NULL, pFrame->pCur, ATRHS, pBind);
+				default:
+					WALK_RETURN(pFrame->pCur);
+				}
 			}
-			break;
 		case MODIFY_EXPR:
-			{
+			switch (pFrame->step) {
+			case 0:
 				if (type == ATCFG) {
-					CFGNode *pCur = newCFGNode(TREE_NAME(node), NTNORMAL);
+					CFGNode *pCur = newCFGNode(pCtx, TREE_NAME(node), NTNORMAL);
 
 					if (pPrev->nType != NTGOTO)
 						pPrev->next = pCur;
-					pRet = pCur;
+					pFrame->pCur = pCur;
 				} else 
-					pRet = pPrev;
-
-				walkStmt(TREE_OPERAND(node, 0), 
-					NULL, pRet, ATLHS, pBind);
-				walkStmt(TREE_OPERAND(node, 1), 
-					NULL, pRet, ATRHS, pBind);
+					pFrame->pCur = pPrev;
+
+				WALK_CHILD(1, TREE_OPERAND(node, 0), 
+					NULL, pFrame->pCur, ATLHS, pBind);
+			case 1:
+				WALK_CHILD(2, TREE_OPERAND(node, 1), 
+					NULL, pFrame->pCur, ATRHS, pBind);
+			default:
+				WALK_RETURN(pFrame->pCur);
 			}
-			break;
 		case COND_EXPR:
 			if (TREE_TYPE (node) == NULL || 
 				TREE_TYPE (node) == void_type_node) 
 			{
-				CFGNode *pCond = newCFGNode("IF_BEG", NTIF);
-				CFGNode *pEnd = newCFGNode("IF_END", NTNORMAL);
+				switch (pFrame->step) {
+				case 0:
+					pFrame->pCur = newCFGNode(pCtx, "IF_BEG", NTIF);
+					pFrame->pEnd = newCFGNode(pCtx, "IF_END", NTNORMAL);
 
-				if (pPrev->nType != NTGOTO)
-					pPrev->next = pCond;
+					if (pPrev->nType != NTGOTO)
+						pPrev->next = pFrame->pCur;
 
-				walkStmt(COND_EXPR_COND(node), 
-					NULL, pCond, ATRHS, pBind);
+					WALK_CHILD(1, COND_EXPR_COND(node), 
+						NULL, pFrame->pCur, ATRHS, pBind);
+				case 1:
+					if (COND_EXPR_THEN(node)) {
+						pFrame->pBranch = newCFGNode(pCtx, "IF_TRUE", NTNORMAL);
 
-				if (COND_EXPR_THEN(node)) {
-					/* Last expression of then body */
-					CFGNode *pLastExpr;
-					CFGNode *pTrue = newCFGNode("IF_TRUE", NTNORMAL);
-					
-					pLastExpr = walkStmt(COND_EXPR_THEN(node), 
-						NULL, pTrue, ATCFG, pBind);
-					
-					if (pLastExpr->nType != NTGOTO)
-						pLastExpr->next = pEnd;
+						WALK_CHILD(2, COND_EXPR_THEN(node), 
+							NULL, pFrame->pBranch, ATCFG, pBind);
+					}
+					/* fall through */
+				case 2:
+					if (COND_EXPR_THEN(node)) {
+						/* pChild is the last expression of then body */
+						if (pChild->nType != NTGOTO)
+							pChild->next = pFrame->pEnd;
+
+						pFrame->pCur->bTrue = pFrame->pBranch;
+					}
 
-					pCond->bTrue = pTrue;
-				} 
+					/* If may has ELSE or not */
+					if (COND_EXPR_ELSE(node)) {
+						pFrame->pBranch = newCFGNode(pCtx, "IF_FALSE", NTNORMAL);
 
-				/* If may has ELSE or not */
-				if (COND_EXPR_ELSE(node)) {
-					/* Last expression of else body */
-					CFGNode *pLastExpr;
-					CFGNode *pFalse = newCFGNode("IF_FALSE", NTNORMAL);
-					
-					pLastExpr =	walkStmt(COND_EXPR_ELSE(node), 
-						NULL, pFalse, ATCFG, pBind);
+						WALK_CHILD(3, COND_EXPR_ELSE(node), 
+							NULL, pFrame->pBranch, ATCFG, pBind);
+					}
 
-					if (pLastExpr->nType != NTGOTO)
-						pLastExpr->next = pEnd;
+					pFrame->pCur->bFalse = pFrame->pEnd;
+					WALK_RETURN(pFrame->pEnd);
+				default:
+					/* pChild is the last expression of else body */
+					if (pChild->nType != NTGOTO)
+						pChild->next = pFrame->pEnd;
 
-					pCond->bFalse = pFalse;
-				} else {
-					pCond->bFalse = pEnd;
+					pFrame->pCur->bFalse = pFrame->pBranch;
+					WALK_RETURN(pFrame->pEnd);
 				}
-
-				pRet = pEnd;
-			} else {
-
-				walkStmt(COND_EXPR_COND(node), NULL, pPrev, ATRHS, pBind);
-				walkStmt(COND_EXPR_THEN(node), NULL, pPrev, ATRHS, pBind);
-				walkStmt(COND_EXPR_ELSE(node), NULL, pPrev, ATRHS, pBind);
-				pRet = pPrev;
+			} 
+
+			switch (pFrame->step) {
+			case 0:
+				WALK_CHILD(1, COND_EXPR_COND(node), NULL, pPrev, ATRHS, pBind);
+			case 1:
+				WALK_CHILD(2, COND_EXPR_THEN(node), NULL, pPrev, ATRHS, pBind);
+			case 2:
+				WALK_CHILD(3, COND_EXPR_ELSE(node), NULL, pPrev, ATRHS, pBind);
+			default:
+				WALK_RETURN(pPrev);
 			}
-			break;
 		case CALL_EXPR:
-			{
-				/*
-				 * Function call can be a statement or part of expression
-				 * Example as stmt:		 foo(a);
-				 * Example as expr part: int a = i + foo(i);
-				 */
+			/*
+			 * Function call can be a statement or part of expression
+			 * Example as stmt:		 foo(a);
+			 * Example as expr part: int a = i + foo(i);
+			 */
+			if (pFrame->step == 0) {
 				if (type == ATCFG) {
-					CFGNode *pCur = newCFGNode(TREE_NAME(node), NTNORMAL);
+					CFGNode *pCur = newCFGNode(pCtx, TREE_NAME(node), NTNORMAL);
 					char *funcName = 
 						IDENTIFIER_POINTER(
 							DECL_NAME(TREE_OPERAND(CALL_EXPR_FN(node), 0)));
 
 					/* Handling special case to make it as defined */
 					if (strcmp(funcName, "scanf") == 0) {
-						type = ATLHS;
+						pFrame->type = ATLHS;
 					} else
-						type = ATRHS;
+						pFrame->type = ATRHS;
 
 					if (pPrev->nType != NTGOTO)
 						pPrev->next = pCur;
-					pRet = pCur;
+					pFrame->pCur = pCur;
 				} else
-					pRet = pPrev;
-					
-				tree arg;
-				call_expr_arg_iterator iter;
+					pFrame->pCur = pPrev;
 
-				FOR_EACH_CALL_EXPR_ARG (arg, iter, node) {
-					walkStmt(arg, NULL, pRet, type, pBind);
-				}
+				pFrame->argIdx = 0;
+			} else
+				pFrame->argIdx++;
+					
+			if (pFrame->argIdx < call_expr_nargs(node)) {
+				WALK_CHILD(1, CALL_EXPR_ARG(node, pFrame->argIdx), 
+					NULL, pFrame->pCur, pFrame->type, pBind);
 			}
-			break;
+
+			WALK_RETURN(pFrame->pCur);
 		case RETURN_EXPR:
-			{
-				CFGNode *pCur = newCFGNode(TREE_NAME(node), NTNORMAL);
+			if (pFrame->step == 0) {
+				CFGNode *pCur = newCFGNode(pCtx, TREE_NAME(node), NTNORMAL);
 				tree op0 = TREE_OPERAND(node, 0);
 
 				if (pPrev->nType != NTGOTO)
 					pPrev->next = pCur;
+				pFrame->pCur = pCur;
 	
 				if (op0) {
 					/* Don't know why */
@@ -596,123 +688,134 @@ try:
 						op0 = TREE_OPERAND(op0, 1);
 					}
 
-					walkStmt(op0, NULL, pCur, ATRHS, pBind);
+					WALK_CHILD(1, op0, NULL, pCur, ATRHS, pBind);
 				}
-				pRet = pCur;
 			}
-			break;
+
+			WALK_RETURN(pFrame->pCur);
 		case COMPOUND_EXPR:
-			{
-				tree *tp;
+			/* Right nested chains are walked in this frame */
+			if (pFrame->step == 0)
+				WALK_CHILD(1, TREE_OPERAND(node, 0), NULL, pPrev, ATRHS, pBind);
 
-				walkStmt(TREE_OPERAND(node, 0), 
+			if (pFrame->step == 1)
+				pFrame->tp = &TREE_OPERAND(node, 1);
+			else
+				pFrame->tp = &TREE_OPERAND(*pFrame->tp, 1);
+
+			if (TREE_CODE(*pFrame->tp) == COMPOUND_EXPR) {
+				WALK_CHILD(2, TREE_OPERAND(*pFrame->tp, 0), 
 					NULL, pPrev, ATRHS, pBind);
-				
-				for (tp=&TREE_OPERAND(node, 1);
-					 TREE_CODE(*tp)==COMPOUND_EXPR;
-					 tp=&TREE_OPERAND(*tp, 1))
-				{
-					walkStmt(TREE_OPERAND(*tp, 0), 
-						NULL, pPrev, ATRHS, pBind);
-				}
 			}
-			break;
-		case SWITCH_EXPR: 
-			{
-				CFGNode *pCur = newCFGNode("SWITCH_COND", NTSWITCH);
-				CFGNode *pEnd = newCFGNode("SWITCH_END", NTNORMAL);
-				bool hasBreak = nextNode && TREE_CODE(nextNode) == LABEL_EXPR;
 
-				if (pPrev->nType != NTGOTO)
-					pPrev->next = pCur;
+			WALK_RETURN(NULL);
+		case SWITCH_EXPR: 
+			switch (pFrame->step) {
+			case 0:
+				{
+					tree nextNode = pFrame->nextNode;
 
-				/* Switch may have break or not */
-				if (hasBreak)
-					newSwitchData(pCur, pEnd, DECL_UID(TREE_OPERAND(nextNode, 0)));
-				else
-					newSwitchData(pCur, pEnd, 0);
+					pFrame->pCur = newCFGNode(pCtx, "SWITCH_COND", NTSWITCH);
+					pFrame->pEnd = newCFGNode(pCtx, "SWITCH_END", NTNORMAL);
+					pFrame->hasBreak = 
+						nextNode && TREE_CODE(nextNode) == LABEL_EXPR;
 
-				walkStmt(SWITCH_COND(node), 
-					NULL, pCur, ATRHS, pBind);
+					if (pPrev->nType != NTGOTO)
+						pPrev->next = pFrame->pCur;
 
-				walkStmt(SWITCH_BODY(node), 
-					NULL, pCur, ATCFG, pBind)->next = pEnd;
+					/* Switch may have break or not */
+					if (pFrame->hasBreak)
+						newSwitchData(pCtx, pFrame->pCur, pFrame->pEnd, 
+							DECL_UID(TREE_OPERAND(nextNode, 0)));
+					else
+						newSwitchData(pCtx, pFrame->pCur, pFrame->pEnd, 0);
 
-				/* If there is no default label, switch may act as IF */
-				if (!pSwitchList->hasDefault) {
-					pCur->caseTable[pCur->caseNum++] = pEnd;
+					WALK_CHILD(1, SWITCH_COND(node), 
+						NULL, pFrame->pCur, ATRHS, pBind);
 				}
-
-				/* This switch has bind scope */
-				if (pSwitchList->pBind) 
+			case 1:
+				WALK_CHILD(2, SWITCH_BODY(node), 
+					NULL, pFrame->pCur, ATCFG, pBind);
+			default:
 				{
-					pCur->next = pSwitchList->pBind;
-					pSwitchList->pBind->caseTable = pCur->caseTable;
-					pSwitchList->pBind->caseNum = pCur->caseNum;
-					pCur->caseTable = pCur->caseNum = 0;
-				}
+					CFGNode *pCur = pFrame->pCur;
+					CFGNode *pEnd = pFrame->pEnd;
+
+					pChild->next = pEnd;
+
+					/* If there is no default label, switch may act as IF */
+					if (!pCtx->pSwitchList->hasDefault) {
+						addCase(pCtx, pCur, pEnd);
+					}
+
+					/* This switch has bind scope */
+					if (pCtx->pSwitchList->pBind) 
+					{
+						pCur->next = pCtx->pSwitchList->pBind;
+						pCtx->pSwitchList->pBind->caseTable = pCur->caseTable;
+						pCtx->pSwitchList->pBind->caseNum = pCur->caseNum;
+						pCtx->pSwitchList->pBind->caseCap = pCur->caseCap;
+						pCur->caseTable = NULL;
+						pCur->caseNum = pCur->caseCap = 0;
+					}
 
-				/* For switch has no break, switchDat should be freed here */
-				if (!hasBreak)
-					freeSwitchData();
+					/* For switch has no break, switchDat should be freed here */
+					if (!pFrame->hasBreak)
+						freeSwitchData(pCtx);
 				
-				pRet = pEnd;
+					WALK_RETURN(pEnd);
+				}
 			}
-			break;
 		case GOTO_EXPR:
 			{
 				unsigned int gotoID = DECL_UID(GOTO_DESTINATION(node));
 
-				sprintf(tmpBuf, "GOTO <D.%d>", gotoID);
+				sprintf(pCtx->tmpBuf, "GOTO <D.%d>", gotoID);
 
-				CFGNode *pCur = newCFGNode(tmpBuf, NTGOTO);
+				CFGNode *pCur = newCFGNode(pCtx, pCtx->tmpBuf, NTGOTO);
 				pPrev->next = pCur;
-				pRet = pCur;
 				pCur->labelID = gotoID;
 		
 				/* Check for switch goto */
-				if (pSwitchList && gotoID == pSwitchList->exitID)
-					pCur->next = pSwitchList->switchExit;
+				if (pCtx->pSwitchList && gotoID == pCtx->pSwitchList->exitID)
+					pCur->next = pCtx->pSwitchList->switchExit;
 				else
-					handleGoto(pCur);
+					handleGoto(pCtx, pCur);
 
+				WALK_RETURN(pCur);
 			}
-			break;
 		case LABEL_EXPR:
-			pRet = pPrev;
-
-			if (pSwitchList &&
-				pSwitchList->exitID == DECL_UID(TREE_OPERAND(node, 0))) 
+			if (pCtx->pSwitchList &&
+				pCtx->pSwitchList->exitID == DECL_UID(TREE_OPERAND(node, 0))) 
 			{
-				freeSwitchData();
+				freeSwitchData(pCtx);
+				WALK_RETURN(pPrev);
 			} else {
-				sprintf(tmpBuf, "<D.%d>", DECL_UID(TREE_OPERAND(node, 0)));
-				CFGNode *pCur = newCFGNode(tmpBuf, NTLABEL);
+				sprintf(pCtx->tmpBuf, "<D.%d>", DECL_UID(TREE_OPERAND(node, 0)));
+				CFGNode *pCur = newCFGNode(pCtx, pCtx->tmpBuf, NTLABEL);
 				pCur->labelID = DECL_UID(TREE_OPERAND(node, 0));
-				pRet = pCur;
 				
 				if (pPrev->nType != NTGOTO)
 					pPrev->next = pCur;
 				
-				handleLabel(pCur);
+				handleLabel(pCtx, pCur);
+				WALK_RETURN(pCur);
 			}
-			break;
 		case CASE_LABEL_EXPR:
-			assert(pSwitchList);
+			assert(pCtx->pSwitchList);
 			{
-				CFGNode *pSwitchEntry = pSwitchList->switchEntry;
-				CFGNode *pCur = newCFGNode("CASE", NTNORMAL);
-				pSwitchEntry->caseTable[pSwitchEntry->caseNum++] = pCur;
-				pRet = pCur;
+				CFGNode *pSwitchEntry = pCtx->pSwitchList->switchEntry;
+				CFGNode *pCur = newCFGNode(pCtx, "CASE", NTNORMAL);
+				addCase(pCtx, pSwitchEntry, pCur);
 				if (pPrev->nType != NTGOTO)
 					pPrev->next = pCur;
 
 				/* It is default case label */
 				if (!CASE_LOW(node))
-					pSwitchList->hasDefault = true;
-			}
+					pCtx->pSwitchList->hasDefault = true;
 
-			break;
+				WALK_RETURN(pCur);
+			}
 		case FLOAT_EXPR:
 		case PLUS_EXPR:
 		case MINUS_EXPR:
@@ -733,32 +836,36 @@ try:
 		case POSTDECREMENT_EXPR:
 		case PREINCREMENT_EXPR:
 		case PREDECREMENT_EXPR:
-			{
+			switch (pFrame->step) {
+			case 0:
 				/* 
 				 * Expression without any effect is perfact legal in gcc 
 				 * Ex. a + 1;
 				 */
 				if (type == ATCFG) {
-					CFGNode *pCur = newCFGNode(TREE_NAME(node), NTNORMAL);
+					CFGNode *pCur = newCFGNode(pCtx, TREE_NAME(node), NTNORMAL);
 				
 					pPrev->next = pCur;
-					pRet = pCur;
+					pFrame->pCur = pCur;
 				} else {
-					pRet = pPrev;
+					pFrame->pCur = pPrev;
 				}
 				if (TREE_OPERAND(node, 0))
-					walkStmt(TREE_OPERAND(node, 0), 
-						NULL, pRet, ATRHS, pBind);
-				if (TREE_OPERAND(node, 1) && TREE_CODE(node) != FLOAT_EXPR)
-					walkStmt(TREE_OPERAND(node, 1), 
-						NULL, pRet, ATRHS, pBind);
+					WALK_CHILD(1, TREE_OPERAND(node, 0), 
+						NULL, pFrame->pCur, ATRHS, pBind);
+				/* fall through */
+			case 1:
+				if (TREE_CODE(node) != FLOAT_EXPR && TREE_OPERAND(node, 1))
+					WALK_CHILD(2, TREE_OPERAND(node, 1), 
+						NULL, pFrame->pCur, ATRHS, pBind);
+				/* fall through */
+			default:
+				WALK_RETURN(pFrame->pCur);
 			}
-			break;
 		case VAR_DECL:
 		case PARM_DECL: 
 			{
-				Operand *pOp = 
-					newOperand(IDENTIFIER_POINTER((DECL_NAME(node))), pBind);
+				Operand *pOp = newOperand(pCtx, node, pBind);
 
 				assert(type == ATLHS || type == ATRHS);
 
@@ -772,51 +879,498 @@ try:
 		default:
 			break;
 	}
+
+	WALK_RETURN(NULL);
+}
+
+/*
+ * Build the CFG of a tree hanging off pPrev and return the last node
+ * of it. Nested trees are handled by the work stack of the context,
+ * so the nesting depth is only limited by memory.
+ */
+CFGNode* walkStmt(AnalysisCtx *pCtx, tree node, tree nextNode, 
+	CFGNode *pPrev, ActionType type, CFGNode *pBind)
+{
+	int base = pCtx->walkTop;
+	CFGNode *pRet = NULL;
+
+	walkPush(pCtx, node, nextNode, pPrev, type, pBind);
+
+	while (pCtx->walkTop > base) {
+		WalkFrame *pFrame = &pCtx->walkStack[pCtx->walkTop - 1];
+
+		if (walkStep(pCtx, pFrame, pRet, &pRet))
+			pCtx->walkTop--;
+	}
+
 	return pRet;
 }
 
-void init()
+/* Mix one word into a function key */
+static inline unsigned long keyMix(unsigned long key, unsigned long val)
+{
+	return ((key << 5 | key >> 59) ^ val) * 0x9E3779B97F4A7C15UL;
+}
+
+static unsigned long keyMixStr(unsigned long key, const char *str)
+{
+	size_t len = strlen(str);
+	unsigned long word;
+
+	key = keyMix(key, len);
+	for (; len >= sizeof(word); str += sizeof(word), len -= sizeof(word)) {
+		memcpy(&word, str, sizeof(word));
+		key = keyMix(key, word);
+	}
+
+	if (len) {
+		word = 0;
+		memcpy(&word, str, len);
+		key = keyMix(key, word);
+	}
+
+	return key;
+}
+
+static bool cmpKeyDecl(void *a, void *b)
 {
-	labelNum = gotoNum = 0;
-	numBindNode = numCFGNode = 0;
-	cfgList = NULL;
-	gVarTable = hashCreateTable(256);
+	return ((KeyDecl *)a)->decl == ((KeyDecl *)b)->decl;
 }
 
-void fin()
+/* 
+ * A decl goes into the key by its code, its name and the order it is
+ * first met in, never by its address or DECL_UID. Those change when
+ * unrelated code changes, the order does not.
+ */
+static unsigned long keyMixDecl(AnalysisCtx *pCtx, unsigned long key, 
+	tree decl)
 {
-	hashDeleteTable(gVarTable, delData);
+	KeyDecl entry, *pEntry;
+
+	entry.decl = decl;
+	pEntry = hashLookupTable(pCtx->keyTable, hashDecl(decl), 
+		cmpKeyDecl, &entry, false);
+
+	if (!pEntry) {
+		pEntry = (KeyDecl *) arenaAlloc(&pCtx->arena, sizeof(KeyDecl));
+		pEntry->decl = decl;
+		pEntry->idx = pCtx->keyDeclNum++;
+		hashLookupTable(pCtx->keyTable, hashDecl(decl), 
+			cmpKeyDecl, pEntry, true);
+	}
+
+	key = keyMix(key, TREE_CODE(decl));
+	key = keyMix(key, pEntry->idx);
+	if (DECL_NAME(decl))
+		key = keyMixStr(key, IDENTIFIER_POINTER(DECL_NAME(decl)));
+
+	return key;
+}
 
-	while (cfgList) {
-		CFGNode *ptr = cfgList;
-		freeCFGNode(ptr);
+static void keyPush(AnalysisCtx *pCtx, int *pTop, tree node)
+{
+	if (*pTop == pCtx->keyCap) {
+		pCtx->keyCap = pCtx->keyCap ? pCtx->keyCap << 1 : 256;
+		pCtx->keyStack = 
+			(tree *) xrealloc(pCtx->keyStack, sizeof(tree) * pCtx->keyCap);
 	}
+
+	pCtx->keyStack[(*pTop)++] = node;
 }
+
+/*
+ * Structural hash of a function, the key of its result in the cache.
+ * It covers the name of the function and everything of the body that
+ * walkStmt reads: tree codes in preorder, with a token for missing
+ * operands, statement and argument counts, decls (see keyMixDecl),
+ * declaration initializers and integer constants. Two functions with
+ * the same key give the same output.txt line.
+ */
+static unsigned long funcKey(AnalysisCtx *pCtx, tree fn)
+{
+	unsigned long key = CACHE_VERSION;
+	int top = 0;
+	int i;
+
+	pCtx->keyDeclNum = 0;
+	/* The cached text is in the result format of the run */
+	key = keyMix(key, gOutputMode);
+	key = keyMixStr(key, IDENTIFIER_POINTER(DECL_NAME(fn)));
+	keyPush(pCtx, &top, DECL_SAVED_TREE(fn));
+
+	while (top) {
+		tree node = pCtx->keyStack[--top];
+		int base = top;
+
+		if (!node) {
+			key = keyMix(key, MAX_TREE_CODES);
+			continue;
+		}
+
+		key = keyMix(key, TREE_CODE(node));
+
+		if (DECL_P(node)) {
+			key = keyMixDecl(pCtx, key, node);
+			continue;
+		}
+
+		switch (TREE_CODE(node)) {
+			case STATEMENT_LIST: {
+				tree_stmt_iterator iter;
+
+				for (iter=tsi_start(node); !tsi_end_p(iter); tsi_next(&iter))
+					keyPush(pCtx, &top, tsi_stmt(iter));
+				key = keyMix(key, top - base);
+				break;
+			}
+			case BIND_EXPR: {
+				tree decl;
+
+				for (i=0, decl=BIND_EXPR_VARS(node); decl; 
+					decl=DECL_CHAIN(decl), i++)
+					key = keyMixDecl(pCtx, key, decl);
+				key = keyMix(key, i);
+				keyPush(pCtx, &top, BIND_EXPR_BODY(node));
+				break;
+			}
+			case DECL_EXPR:
+				key = keyMixDecl(pCtx, key, DECL_EXPR_DECL(node));
+				keyPush(pCtx, &top, DECL_INITIAL(DECL_EXPR_DECL(node)));
+				break;
+			case CALL_EXPR:
+				key = keyMix(key, call_expr_nargs(node));
+				keyPush(pCtx, &top, CALL_EXPR_FN(node));
+				for (i=0; i<call_expr_nargs(node); i++)
+					keyPush(pCtx, &top, CALL_EXPR_ARG(node, i));
+				break;
+			case INTEGER_CST:
+				key = keyMix(key, TREE_INT_CST_LOW(node));
+				break;
+			case COND_EXPR:
+				/* walkStmt builds an if only for a void COND_EXPR */
+				key = keyMix(key, TREE_TYPE(node) == NULL || 
+					TREE_TYPE(node) == void_type_node);
+				for (i=0; i<TREE_OPERAND_LENGTH(node); i++)
+					keyPush(pCtx, &top, TREE_OPERAND(node, i));
+				break;
+			default:
+				if (EXPR_P(node)) {
+					for (i=0; i<TREE_OPERAND_LENGTH(node); i++)
+						keyPush(pCtx, &top, TREE_OPERAND(node, i));
+				}
+				break;
+		}
+
+		/* Children were pushed in order, visit them in order */
+		for (i=0; i<(top - base) / 2; i++) {
+			tree tmp = pCtx->keyStack[base + i];
+
+			pCtx->keyStack[base + i] = pCtx->keyStack[top - 1 - i];
+			pCtx->keyStack[top - 1 - i] = tmp;
+		}
+	}
+
+	/* Key 0 is never stored */
+	key ^= key >> 33;
+	key *= 0xFF51AFD7ED558CCDUL;
+	key ^= key >> 33;
+
+	return key ? key : 1;
+}
+
+AnalysisCtx *newAnalysisCtx(FILE *traceFile)
+{
+	AnalysisCtx *pCtx = (AnalysisCtx *) xcalloc(1, sizeof(AnalysisCtx));
+
+	pCtx->traceFile = traceFile;
+
+	/* 
+	 * The tables are cleared, not freed, between functions. They keep
+	 * the size the last functions needed, see hashClearTable().
+	 */
+	pCtx->labelTable = hashCreateTable(64);
+	pCtx->varTable = hashCreateTable(256);
+	pCtx->declTable = hashCreateTable(256);
+	pCtx->keyTable = hashCreateTable(256);
+
+	/* Counters count the creating thread, the worker owning the ctx */
+	pCtx->perf.missFd = pCtx->perf.refFd = -1;
+	if (TRACE_ON(TRACE_CFG))
+		perfOpen(&pCtx->perf);
+
+	return pCtx;
+}
+
+void freeAnalysisCtx(AnalysisCtx *pCtx)
+{
+	hashDeleteTable(pCtx->varTable, NULL);
+	hashDeleteTable(pCtx->declTable, NULL);
+	hashDeleteTable(pCtx->labelTable, NULL);
+	hashDeleteTable(pCtx->keyTable, NULL);
+	free(pCtx->varList);
+	free(pCtx->walkStack);
+	free(pCtx->keyStack);
+	freeDFAScratch(pCtx);
+	perfClose(&pCtx->perf);
+	arenaFree(&pCtx->arena);
+	free(pCtx);
+}
+
+void init(AnalysisCtx *pCtx)
+{
+	pCtx->pSwitchList = NULL;
+	pCtx->numBindNode = pCtx->numCFGNode = 0;
+	pCtx->scopeNum = 0;
+	pCtx->cfgList = NULL;
+	pCtx->varNum = 0;
+	memset(&pCtx->stats, 0, sizeof(FuncStats));
+}
+
+/* 
+ * Release the function. Nodes and everything they point to live in
+ * the arena and go away with one reset.
+ */
+void fin(AnalysisCtx *pCtx)
+{
+	freeDFA(pCtx);
+	/* Variables live in the arena */
+	hashClearTable(pCtx->varTable);
+	hashClearTable(pCtx->declTable);
+	hashClearTable(pCtx->labelTable);
+	hashClearTable(pCtx->keyTable);
+
+	pCtx->cfgList = NULL;
+	arenaReset(&pCtx->arena);
+}
+
+/* 
+ * Build the CFG of one function, run DFA on it and write the result.
+ * With a cache the result comes from there if the function was seen
+ * before, and goes there otherwise. Phase times and counters are left
+ * in pCtx->stats.
+ */
+void analyzeFunction(AnalysisCtx *pCtx, FILE *file, tree fn)
+{
+	tree body = DECL_SAVED_TREE((fn));
+	char *funcName = IDENTIFIER_POINTER(DECL_NAME(fn));
+	CFGNode entry, *pEntry;
+	FILE *result = file;
+	char *text = NULL;
+	size_t len = 0;
+	unsigned long key = 0;
+	double mark = 0;
+
+	init(pCtx);
+
+	if (STATS_ON())
+		mark = statsNow();
+
+	/* An exported CFG needs the walk, so the cache is skipped */
+	if (gCache.pHead && !pCtx->cfgFile) {
+		key = funcKey(pCtx, fn);
+		if (STATS_ON())
+			statsLap(&pCtx->stats, PHASE_KEY, &mark);
+
+		if (cacheLookup(key, file)) {
+			if (TRACE_ON(TRACE_CFG))
+				fprintf(pCtx->traceFile, "%s: cached %016lx\n", funcName, key);
+			pCtx->stats.cached = true;
+			goto done;
+		}
+
+		result = open_memstream(&text, &len);
+	}
+
+	/* 
+	 * Entry is only a predecessor for the first statement. It is
+	 * never put in cfgList, so there is nothing to unlink later.
+	 */
+	memset(&entry, 0, sizeof(CFGNode));
+	entry.nType = NTNORMAL;
+	entry.info = "Entry";
+	
+	if (TRACE_ON(TRACE_CFG)) {
+		pthread_mutex_lock(&gPrintLock);
+		print_c_tree(pCtx->traceFile, body);
+		pthread_mutex_unlock(&gPrintLock);
+	}
+	
+	if (STATS_ON())
+		mark = statsNow();
+	walkStmt(pCtx, body, NULL, &entry, ATCFG, NULL);
+	pEntry = entry.next;
+	if (STATS_ON())
+		statsLap(&pCtx->stats, PHASE_WALK, &mark);
+
+	doDFA(pCtx, result, pEntry, funcName);
+
+	if (result != file) {
+		fclose(result);
+		fwrite(text, 1, len, file);
+		pCtx->stats.tooLong = len > CACHE_TEXT_MAX;
+		cacheStore(key, text, len);
+		free(text);
+	}
+
+	if (pCtx->cfgFile)
+		cfgExport(pCtx, pCtx->cfgFile, pEntry, funcName);
+
+	if (TRACE_ON(TRACE_CFG)) {
+		dumpCFG(pCtx, pEntry);
+		hashDumpStats(pCtx->varTable, pCtx->traceFile, "varTable");
+	}
+
+done:
+	if (STATS_ON())
+		mark = statsNow();
+	fin(pCtx);
+	if (STATS_ON())
+		statsLap(&pCtx->stats, PHASE_FREE, &mark);
+}
+
+/* 
+ * Thread pool worker. Every worker owns one context and keeps
+ * taking the next function until the queue is drained. Results
+ * and traces are kept in memory so they can be written in cgraph
+ * order.
+ */
+static void *analysisWorker(void *arg)
+{
+	JobQueue *pQueue = (JobQueue *)arg;
+	AnalysisCtx *pCtx = newAnalysisCtx(NULL);
+	int idx;
+
+	while ((idx = __sync_fetch_and_add(&pQueue->nextJob, 1)) < 
+		pQueue->jobNum) 
+	{
+		FuncJob *pJob = &pQueue->jobs[idx];
+		FILE *file = open_memstream(&pJob->result, &pJob->resultLen);
+
+		if (TRACE_ON(TRACE_CFG))
+			pCtx->traceFile = open_memstream(&pJob->trace, &pJob->traceLen);
+		if (gCfgFile)
+			pCtx->cfgFile = open_memstream(&pJob->cfg, &pJob->cfgLen);
+
+		analyzeFunction(pCtx, file, pJob->fn);
+		fclose(file);
+		pJob->stats = pCtx->stats;
+
+		if (TRACE_ON(TRACE_CFG))
+			fclose(pCtx->traceFile);
+		if (gCfgFile)
+			fclose(pCtx->cfgFile);
+	}
+
+	freeAnalysisCtx(pCtx);
+	return NULL;
+}
+
+/* 
+ * Number of analysis threads, from CS502_THREADS. Unset means one
+ * thread, "auto" means one per online core.
+ */
+static int getThreadNum()
+{
+	char *env = getenv("CS502_THREADS");
+	int num;
+
+	if (!env)
+		return 1;
+
+	if (strcmp(env, "auto") == 0)
+		num = sysconf(_SC_NPROCESSORS_ONLN);
+	else
+		num = atoi(env);
+
+	return num < 1 ? 1 : num;
+}
+
 void cs502_proj2()
 {
 	struct cgraph_node *node;
-	FILE *file = fopen("output.txt", "w");
+	char *outBuf = (char *) xmalloc(OUTPUT_BUF_SIZE);
+	int threadNum = getThreadNum();
+	FILE *file;
+
+	traceInit();
+	dfaEngineInit();
+	dfaOutputInit();
+
+	/* All results of the unit leave in a few large writes */
+	file = fopen(gOutputMode == OUTPUT_JSONL ? "output.jsonl" : "output.txt",
+		"w");
+	setvbuf(file, outBuf, _IOFBF, OUTPUT_BUF_SIZE);
+	cacheInit();
+	cfgExportInit();
+	statsInit();
+
+	if (threadNum == 1) {
+		AnalysisCtx *pCtx = newAnalysisCtx(gTraceFile);
+
+		pCtx->cfgFile = gCfgFile;
+
+		/* Walk through all functions */
+		for (node=cgraph_nodes; node; node=node->next) {
+			analyzeFunction(pCtx, file, node->decl);
+			if (STATS_ON())
+				statsFunc(IDENTIFIER_POINTER(DECL_NAME(node->decl)), 
+					&pCtx->stats);
+		}
 
-	/* Walk through all functions */
-	for (node=cgraph_nodes; node; node=node->next) {
-		tree fn = node->decl;
-		tree body = DECL_SAVED_TREE((fn));
-	
-		init();
-		CFGNode *pEntry = newCFGNode("Entry", NTNORMAL), *pTmp = pEntry;
-		
-		print_c_tree(stdout, body);
-		
-		walkStmt(body, NULL, pEntry, ATCFG, NULL);
-		pEntry = pEntry->next;
-		freeCFGNode(pTmp);
+		freeAnalysisCtx(pCtx);
+	} else {
+		JobQueue queue;
+		pthread_t *threads;
+		int i;
+
+		memset(&queue, 0, sizeof(JobQueue));
+
+		for (node=cgraph_nodes; node; node=node->next)
+			queue.jobNum++;
+
+		queue.jobs = (FuncJob *) xcalloc(queue.jobNum + 1, sizeof(FuncJob));
+		for (i=0, node=cgraph_nodes; node; node=node->next, i++)
+			queue.jobs[i].fn = node->decl;
 
-		doDFA(file, cfgList, numBindNode, 
-			IDENTIFIER_POINTER(DECL_NAME(fn)));
+		/* The main thread is one of the workers */
+		threads = (pthread_t *) xmalloc(sizeof(pthread_t) * threadNum);
+		for (i=1; i<threadNum; i++)
+			pthread_create(&threads[i], NULL, analysisWorker, &queue);
 
-		dumpCFG(pEntry);
+		analysisWorker(&queue);
 
-		fin();
+		for (i=1; i<threadNum; i++)
+			pthread_join(threads[i], NULL);
+
+		/* Results go out in the original cgraph order */
+		for (i=0; i<queue.jobNum; i++) {
+			fwrite(queue.jobs[i].result, 1, queue.jobs[i].resultLen, file);
+			free(queue.jobs[i].result);
+
+			if (queue.jobs[i].trace) {
+				fwrite(queue.jobs[i].trace, 1, queue.jobs[i].traceLen, 
+					gTraceFile);
+				free(queue.jobs[i].trace);
+			}
+
+			if (queue.jobs[i].cfg) {
+				fwrite(queue.jobs[i].cfg, 1, queue.jobs[i].cfgLen, gCfgFile);
+				free(queue.jobs[i].cfg);
+			}
+
+			if (STATS_ON())
+				statsFunc(IDENTIFIER_POINTER(DECL_NAME(queue.jobs[i].fn)), 
+					&queue.jobs[i].stats);
+		}
+
+		free(threads);
+		free(queue.jobs);
 	}
+
+	statsFin(threadNum);
+	cfgExportFin();
+	cacheFin();
+	traceFin();
 	fclose(file);
+	free(outBuf);
 }
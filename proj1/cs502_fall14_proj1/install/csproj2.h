@@ -12,12 +12,17 @@
 #include "langhooks.h"
 #include "tree-iterator.h"
 #include "tree.h"
+#include "bitset.h"
+#include "hashtable.h"
+#include "arena.h"
+#include "trace.h"
+#include "perfcnt.h"
+#include "cache.h"
+#include "stats.h"
 
 #define TREE_NAME(t)	\
 	tree_code_name[TREE_CODE(t)]
 
-#define MAX_CASE_NUM	256	
-#define MAX_LABEL_SIZE	256
 
 typedef enum ActionType {
 	ATCFG = 0,
@@ -35,23 +40,98 @@ typedef enum NodeType {
 	NTGOTO,
 } NodeType;
 
+typedef struct Variable {
+	/* Name of the declaration, the scope is pBind */
+	char *name;
+	/* Dense index used by the bit-vector sets */
+	int id;
+	/* 
+	 * Bind declaring the variable, its decl and the index of the decl
+	 * in DECL_CHAIN. pBind is NULL for globals and parameters.
+	 */
+	struct CFGNode *pBind;
+	tree decl;
+	int declIdx;
+} Variable;
+
+/* Maps a VAR_DECL or PARM_DECL to its interned variable */
+typedef struct DeclEntry {
+	tree decl;
+	Variable *pVar;
+} DeclEntry;
+
+/* A decl met by funcKey(), numbered in order of first appearance */
+typedef struct KeyDecl {
+	tree decl;
+	int idx;
+} KeyDecl;
+
 typedef struct Operand {
 	/* Operand's name */
 	char *name;
+	/* Dense index of the variable */
+	int id;
 	/* Pointer to next operand */
 	struct Operand *next;
 } Operand;
 
+/* 
+ * Straight-line run of CFGNodes, each the only successor of the node
+ * before it and the only predecessor of the node after it. The solver
+ * runs on blocks: the in set of a block becomes the in set of its
+ * first node and the out set the out set of its last node.
+ */
+typedef struct BasicBlock {
+	/* Nodes of the block are blockNodes[first .. first + nodeNum - 1] */
+	int first;
+	int nodeNum;
+	/* Successor blocks */
+	struct BasicBlock **succs;
+	int succNum;
+	/* Dense block id, and the index in reverse postorder */
+	int id;
+	int rpo;
+	/* Holds a bind node, whose sets finDFA needs */
+	bool hasBind;
+} BasicBlock;
+
+/*
+ * The block graph as the solver sees it, frozen after it is built.
+ * Blocks are numbered in reverse postorder, edges are kept in CSR
+ * form and the sets of all blocks sit in four contiguous arrays, row
+ * i of a set array at i * setWords. Nothing cold is in here.
+ */
+typedef struct FrozenCFG {
+	int numBlock;
+	/* Block at every reverse postorder index */
+	BasicBlock **blocks;
+	/* Successors of i are succIdx[succStart[i] .. succStart[i + 1] - 1] */
+	int *succStart;
+	int *succIdx;
+	/* Predecessors, in the same form */
+	int *predStart;
+	int *predIdx;
+	/* Block sets, all carved from one pool */
+	BitWord *setPool;
+	BitWord *in;
+	BitWord *out;
+	BitWord *useSet;
+	BitWord *defSet;
+} FrozenCFG;
+
 typedef struct CFGNode {
 	NodeType nType;
 	/* Operands defined in this node */
 	Operand *defOp;
 	/* Operands used in this node */
 	Operand *useOp;
+	/* Def and use sets as bit vectors, built by initDFA */
+	BitWord *defSet;
+	BitWord *useSet;
 	/* In set */
-	Operand *in;
+	BitWord *in;
 	/* Out set */
-	Operand *out;
+	BitWord *out;
 	/* Node info, for debugging */
 	char *info; 
 	/* Next CFG node in cfg list */
@@ -64,13 +144,33 @@ typedef struct CFGNode {
 	/* Used by switch node */
 	struct CFGNode **caseTable;
 	int caseNum;
-	/* Used by bind node */
+	int caseCap;
+	/* 
+	 * Used by bind node. Scopes are numbered in preorder, childIdx is
+	 * the index among the children of parentBind and scopeRank the
+	 * place in the output order, see rankScopes().
+	 */
 	tree decls;			
-	char *bindID;
+	int scopeId;
+	int childIdx;
+	int scopeRank;
 	struct CFGNode *parentBind;
 	int childNum;
 	/* Used by label and goto node */
 	unsigned int labelID;
+	/* Next goto waiting for the same label */
+	struct CFGNode *nextGoto;
+	/* Dense node id and explicit edges, built by initDFA */
+	int id;
+	struct CFGNode **succs;
+	int succNum;
+	struct CFGNode **preds;
+	int predNum;
+	/* Basic block holding this node */
+	BasicBlock *pBlock;
+	/* Immediate dominator and loops around the node, see buildLoops() */
+	struct CFGNode *idom;
+	int loopDepth;
 	/* For debugging use */
 	bool dumped;
 } CFGNode;
@@ -84,7 +184,197 @@ typedef struct SwitchData {
 	bool hasDefault;
 } SwitchData;
 
-void doDFA(FILE *file, CFGNode *dfaList, int bindNum, char *funcName);
-Operand *newOperand(char *name, CFGNode *pBind);
+/* 
+ * A label seen or jumped to in the current function. Gotos seen
+ * before their label wait on gotoList.
+ */
+typedef struct LabelEntry {
+	unsigned int labelID;
+	CFGNode *pLabel;
+	CFGNode *gotoList;
+} LabelEntry;
+
+/*
+ * One pending walkStmt call. The CFG is built with an explicit stack
+ * of these instead of recursion, so deeply nested trees cannot run
+ * out of machine stack. step tells where the call resumes once the
+ * child walk it pushed has returned.
+ */
+typedef struct WalkFrame {
+	tree node;
+	tree nextNode;
+	CFGNode *pPrev;
+	ActionType type;
+	CFGNode *pBind;
+	int step;
+	/* State kept across child walks */
+	CFGNode *pCur;
+	CFGNode *pEnd;
+	CFGNode *pBranch;
+	tree_stmt_iterator iter;
+	tree *tp;
+	int argIdx;
+	bool hasBreak;
+} WalkFrame;
+
+/* Liveness engine doDFA runs, see dfaEngineInit() */
+typedef enum DfaEngine {
+	DFA_AUTO = 0,
+	DFA_DENSE,
+	DFA_SPARSE,
+} DfaEngine;
+
+/* 
+ * In auto mode, functions with at least this many variables go
+ * sparse, unless more than one in SPARSE_UNDEF_RATIO of the used
+ * variables is never defined.
+ */
+#define SPARSE_MIN_VARS 1024
+#define SPARSE_UNDEF_RATIO 16
+
+/* Format of the result lines, see dfaOutputInit() */
+typedef enum OutputMode {
+	OUTPUT_TEXT = 0,
+	OUTPUT_JSONL,
+} OutputMode;
+
+/* Buffer of the result file, output is written in large blocks */
+#define OUTPUT_BUF_SIZE	(1024 * 1024)
+
+/* One function to analyze, its output.txt text and its trace */
+typedef struct FuncJob {
+	tree fn;
+	char *result;
+	size_t resultLen;
+	char *trace;
+	size_t traceLen;
+	char *cfg;
+	size_t cfgLen;
+	FuncStats stats;
+} FuncJob;
+
+/* Functions shared by the workers of the thread pool */
+typedef struct JobQueue {
+	FuncJob *jobs;
+	int jobNum;
+	int nextJob;
+} JobQueue;
+
+/* One uninitialized variable found by finDFA */
+typedef struct Output {
+	char *name;
+	CFGNode *pBind;
+	int order;
+} Output;
+
+/*
+ * Analysis context. All state used while building the CFG of one
+ * function and running the DFA on it lives here, so functions can
+ * be analyzed by several threads at once. A context is owned by one
+ * worker and reset by init()/fin() between functions.
+ */
+typedef struct AnalysisCtx {
+	/* The list of switch information */
+	SwitchData *pSwitchList;
+	/* Label and pending goto nodes, LabelEntry keyed by DECL_UID */
+	HashTable *labelTable;
+	/* Recording number of bind nodes */
+	int numBindNode;
+	/* Scopes numbered so far, the scopeId of the next bind */
+	int scopeNum;
+	/* Recording number of live CFGNodes */
+	int numCFGNode;
+	/* The list of all CFGNodes */
+	CFGNode *cfgList;
+	/* The hash table for storing variables */
+	HashTable *varTable;
+	/* Cache from decl trees to their variables, DeclEntry */
+	HashTable *declTable;
+	/* Interned variables indexed by their dense id */
+	Variable **varList;
+	int varNum;
+	int varCap;
+	/* Work stack of walkStmt, kept between functions */
+	WalkFrame *walkStack;
+	int walkTop;
+	int walkCap;
+	/* Decls and work stack of funcKey(), KeyDecl */
+	HashTable *keyTable;
+	int keyDeclNum;
+	tree *keyStack;
+	int keyCap;
+	/* Owns nodes, operands and names of the current function */
+	Arena arena;
+	/* Sink for trace output, see trace.h */
+	FILE *traceFile;
+	/* Sink for the binary CFG, see cfgexport.h, or NULL */
+	FILE *cfgFile;
+	/* Temporary buffer */
+	char tmpBuf[4096];
+
+	/* 
+	 * Table for recording bind scopes. After backward dfa, all
+	 * bind scopes will be analysed for uninitialized variables.
+	 */
+	CFGNode **bindTable;
+	/* Pool holding the bit-vector sets of all CFGNodes */
+	BitWord *setPool;
+	/* Number of words in every bit-vector set */
+	int setWords;
+	/* 
+	 * Solver scratch, kept between functions: the union of the
+	 * successors' in sets and the work list. See growScratch().
+	 */
+	BitWord *sucIn;
+	int sucInCap;
+	int *dfaHeap;
+	bool *dfaOnList;
+	int dfaHeapCap;
+	/* Pools holding the successor and predecessor edges */
+	CFGNode **succPool;
+	CFGNode **predPool;
+	/* Nodes indexed by id */
+	CFGNode **nodeTable;
+	int numNode;
+	/* Basic blocks, their nodes and the edges between them */
+	BasicBlock *blockTable;
+	CFGNode **blockNodes;
+	BasicBlock **blockSuccPool;
+	int numBlock;
+	/* What the solver runs on */
+	FrozenCFG frozen;
+	/* Cache counters around the solver, when the CFG is traced */
+	PerfCounter perf;
+	/* Solver statistics of the last function */
+	int dfaIterNum;
+	int dfaVisitNum;
+	/* Set unions, whole successor sets dense, single bits sparse */
+	long dfaUnionNum;
+	/* Natural loops of the last function and their deepest nesting */
+	int loopNum;
+	int loopMaxDepth;
+	/* Phase times and counters of the function, see stats.h */
+	FuncStats stats;
+	/* Findings of finDFA, grown on demand and kept between functions */
+	Output *out;
+	int outNum;
+	int outCap;
+} AnalysisCtx;
+
+extern DfaEngine gDfaEngine;
+extern OutputMode gOutputMode;
+
+void dfaEngineInit();
+void dfaOutputInit();
+void printScope(FILE *file, CFGNode *pBind);
+void doDFA(AnalysisCtx *pCtx, FILE *file, CFGNode *pEntry, char *funcName);
+void freeDFA(AnalysisCtx *pCtx);
+void freeDFAScratch(AnalysisCtx *pCtx);
+void buildLoops(AnalysisCtx *pCtx, CFGNode *pEntry);
+void cfgExport(AnalysisCtx *pCtx, FILE *file, CFGNode *pEntry, 
+	const char *funcName);
+Variable *internVar(AnalysisCtx *pCtx, char *name, CFGNode *pBind,
+	tree decl, int declIdx);
+Operand *newOperand(AnalysisCtx *pCtx, tree decl, CFGNode *pBind);
 
 #endif
@@ -14,279 +14,1118 @@
 #include "tree-iterator.h"
 #include "pretty-print.h"
 
-struct Output {
-	char *name;
-	char *bindID;
-	int order;
-} Output;
+int cmpFunc(const void *a, const void *b)
+{
+	Output *pA = (Output *)a;
+	Output *pB = (Output *)b;
+
+	if (pA->pBind != pB->pBind)
+		return pA->pBind->scopeRank - pB->pBind->scopeRank;
+	else
+		return pA->order - pB->order;
+}
+
+/* Print the textual id of a scope, the child indexes from the root */
+void printScope(FILE *file, CFGNode *pBind)
+{
+	int path[64], *pPath = path;
+	int depth = 0, cap = 64, i;
+
+	for (; pBind; pBind=pBind->parentBind) {
+		if (depth == cap) {
+			cap <<= 1;
+			pPath = pPath == path ? 
+				(int *) memcpy(xmalloc(sizeof(int) * cap), path, sizeof(path)) :
+				(int *) xrealloc(pPath, sizeof(int) * cap);
+		}
+		pPath[depth++] = pBind->childIdx;
+	}
+
+	for (i=depth-1; i>=0; i--)
+		fprintf(file, "#%d", pPath[i]);
+
+	if (pPath != path)
+		free(pPath);
+}
 
 /* 
- * Table for recording bind scopes. After backward dfa, all
- * bind scopes will be analysed for uninitialized variables.
+ * Compare two child indexes as their decimal strings compare, so 10
+ * goes between 1 and 2: the one with fewer digits is scaled up to the
+ * other's length, on a tie it is the prefix and comes first.
  */
-CFGNode **bindTable;
-char tmpBuf[4096];
+static int cmpDecimal(const void *a, const void *b)
+{
+	long x = *(const int *)a;
+	long y = *(const int *)b;
+	long px = 1, py = 1;
 
-/* Output table */
-struct Output out[1024];
-int outNum;
+	while (px * 10 <= x)
+		px *= 10;
+	while (py * 10 <= y)
+		py *= 10;
 
-int cmpFunc(const void *a, const void *b)
+	if (px < py)
+		return x * (py / px) <= y ? -1 : 1;
+	if (py < px)
+		return y * (px / py) <= x ? 1 : -1;
+
+	return x < y ? -1 : x > y;
+}
+
+/* 
+ * Give every scope its place in the output order. Results are sorted
+ * by the textual scope id, which is a preorder walk of the scope tree
+ * visiting children in the string order of their indexes. Only scopes
+ * with more than ten children differ from plain preorder.
+ */
+static void rankScopes(AnalysisCtx *pCtx)
+{
+	int scopeNum = pCtx->numBindNode;
+	CFGNode **scopes = (CFGNode **) xmalloc(sizeof(CFGNode *) * (scopeNum + 1));
+	int *childStart = (int *) xcalloc(scopeNum + 1, sizeof(int));
+	int *children = (int *) xmalloc(sizeof(int) * (scopeNum + 1));
+	int *ord = (int *) xmalloc(sizeof(int) * (scopeNum + 1));
+	int *stack = (int *) xmalloc(sizeof(int) * (scopeNum + 1));
+	int i, j, top = 0, rank = 0;
+
+	for (i=0; i<scopeNum; i++) {
+		CFGNode *pBind = pCtx->bindTable[i];
+
+		assert(pBind->scopeId >= 0 && pBind->scopeId < scopeNum);
+		scopes[pBind->scopeId] = pBind;
+	}
+
+	/* Children of every scope in CSR, indexed by childIdx */
+	for (i=0; i<scopeNum; i++)
+		childStart[i + 1] = childStart[i] + scopes[i]->childNum;
+
+	for (i=scopeNum-1; i>=0; i--) {
+		CFGNode *pParent = scopes[i]->parentBind;
+
+		if (pParent)
+			children[childStart[pParent->scopeId] + scopes[i]->childIdx] = i;
+		else
+			stack[top++] = i;
+	}
+
+	while (top) {
+		int s = stack[--top];
+		int n = scopes[s]->childNum;
+
+		scopes[s]->scopeRank = rank++;
+
+		for (j=0; j<n; j++)
+			ord[j] = j;
+		if (n > 10)
+			qsort(ord, n, sizeof(int), cmpDecimal);
+
+		for (j=n-1; j>=0; j--)
+			stack[top++] = children[childStart[s] + ord[j]];
+	}
+
+	free(scopes);
+	free(childStart);
+	free(children);
+	free(ord);
+	free(stack);
+}
+
+DfaEngine gDfaEngine = DFA_AUTO;
+
+/* Read the liveness engine from CS502_DFA: "dense", "sparse" or "auto" */
+void dfaEngineInit()
 {
-	struct Output *pA = (struct Output *)a;
-	struct Output *pB = (struct Output *)b;
+	char *env = getenv("CS502_DFA");
 
-	int ccStr = strcmp(pA->bindID, pB->bindID);
-	
-	if (ccStr != 0)
-		return ccStr;
+	if (!env || strcmp(env, "auto") == 0)
+		gDfaEngine = DFA_AUTO;
+	else if (strcmp(env, "dense") == 0)
+		gDfaEngine = DFA_DENSE;
+	else if (strcmp(env, "sparse") == 0)
+		gDfaEngine = DFA_SPARSE;
 	else
-		return pA->order - pB->order;
+		fprintf(stderr, "CS502_DFA: unknown engine %s, using auto\n", env);
 }
 
-/* Initialization */
-void initDFA(CFGNode *dfaList, int numBind)
+OutputMode gOutputMode = OUTPUT_TEXT;
+
+/* 
+ * Read the result format from CS502_OUTPUT: "text" for the lines of
+ * output.txt, or "jsonl" for one JSON object per function, with the
+ * bind and declaration index of every variable, in output.jsonl.
+ */
+void dfaOutputInit()
 {
-	CFGNode *ptr = dfaList;
+	char *env = getenv("CS502_OUTPUT");
+
+	if (!env || strcmp(env, "text") == 0)
+		gOutputMode = OUTPUT_TEXT;
+	else if (strcmp(env, "jsonl") == 0)
+		gOutputMode = OUTPUT_JSONL;
+	else
+		fprintf(stderr, "CS502_OUTPUT: unknown format %s, using text\n", env);
+}
+
+#define ADD_SUCC(pSuc)	\
+	do { if (pSuc) { if (sucs) sucs[num] = (pSuc); num++; } } while (0)
+
+/* 
+ * Collect the successors of a node in the flow. If sucs is NULL,
+ * only count them.
+ */
+static int collectSucc(CFGNode *ptr, CFGNode **sucs)
+{
+	int num = 0;
 	int i;
 
-	/* Initialize bind table */
-	bindTable = (CFGNode **) xmalloc(sizeof(CFGNode *) * numBind);
-	for (i=0; ptr; ptr=ptr->nextCFG) {
-		if (ptr->nType == NTBIND) {
-			bindTable[i++] = ptr;
-		}
+	switch (ptr->nType) {
+		case NTIF:
+			ADD_SUCC(ptr->bTrue);
+			ADD_SUCC(ptr->bFalse);
+			break;
+		case NTSWITCH:
+			if (ptr->next && ptr->next->nType == NTBIND) {
+				ADD_SUCC(ptr->next);
+			} else {
+				for (i=0; i<ptr->caseNum; i++) {
+					ADD_SUCC(ptr->caseTable[i]);
+				}
+			}
+			break;
+		case NTBIND:
+			if (ptr->caseTable) {
+				for (i=0; i<ptr->caseNum; i++) {
+					ADD_SUCC(ptr->caseTable[i]);
+				}
+			} else {
+				ADD_SUCC(ptr->next);
+			}
+			break;
+		case NTGOTO:
+		case NTLABEL:
+		case NTNORMAL:
+			ADD_SUCC(ptr->next);
+			break;
 	}
-}
 
-/* Global declaration, in case of stack overflow */
-Operand *gSucIn[1024];
-int sInNum;
+	return num;
+}
 
-bool checkSetDup(Operand *pChk, Operand **set, int setNum)
+/* 
+ * Build explicit successor and predecessor edges for every node
+ * in cfgList. Must be called after walkStmt has finished.
+ */
+static void buildEdges(AnalysisCtx *pCtx)
 {
+	CFGNode *ptr;
+	CFGNode **pEdge;
+	int numEdge = 0;
 	int i;
 
-	for (i=0; i<setNum; i++) {
-		if (pChk->name == set[i]->name)
-			return true;
+	for (ptr=pCtx->cfgList; ptr; ptr=ptr->nextCFG) {
+		ptr->succNum = collectSucc(ptr, NULL);
+		ptr->predNum = 0;
+		numEdge += ptr->succNum;
 	}
 
-	return false;
+	pCtx->succPool = (CFGNode **) xmalloc(sizeof(CFGNode *) * (numEdge + 1));
+	pCtx->predPool = (CFGNode **) xmalloc(sizeof(CFGNode *) * (numEdge + 1));
+
+	for (ptr=pCtx->cfgList, pEdge=pCtx->succPool; ptr; ptr=ptr->nextCFG) {
+		ptr->succs = pEdge;
+		pEdge += collectSucc(ptr, ptr->succs);
+
+		for (i=0; i<ptr->succNum; i++)
+			ptr->succs[i]->predNum++;
+	}
+
+	for (ptr=pCtx->cfgList, pEdge=pCtx->predPool; ptr; ptr=ptr->nextCFG) {
+		ptr->preds = pEdge;
+		pEdge += ptr->predNum;
+		ptr->predNum = 0;
+	}
+
+	for (ptr=pCtx->cfgList; ptr; ptr=ptr->nextCFG) {
+		for (i=0; i<ptr->succNum; i++) {
+			CFGNode *pSuc = ptr->succs[i];
+			pSuc->preds[pSuc->predNum++] = ptr;
+		}
+	}
 }
 
-bool checkListDup(Operand *pChk, Operand *pList)
+/*
+ * Coalesce the CFG into basic blocks. A node starts a block unless it
+ * has exactly one predecessor and that predecessor has no other
+ * successor, so forwarding markers like IF_TRUE, CASE or BIND_END end
+ * up inside the blocks around them. Cycles without such a leader get
+ * one picked for them. The entry always starts a block.
+ */
+static void buildBlocks(AnalysisCtx *pCtx, CFGNode *pEntry)
 {
-	while (pList) {
-		if (pChk->name == pList->name)
-			return true;
-		pList = pList->next;
+	int numNode = pCtx->numNode;
+	bool *leader = (bool *) xcalloc(numNode + 1, sizeof(bool));
+	BasicBlock **pSucc;
+	int numBlock = 0, numEdge = 0, num = 0;
+	int pass, i, j;
+
+	for (i=0; i<numNode; i++) {
+		CFGNode *ptr = pCtx->nodeTable[i];
+
+		leader[i] = ptr == pEntry || ptr->predNum != 1 || 
+			ptr->preds[0]->succNum != 1 || ptr->preds[0] == ptr;
+	}
+
+	pCtx->blockTable = 
+		(BasicBlock *) xcalloc(numNode + 1, sizeof(BasicBlock));
+	pCtx->blockNodes = (CFGNode **) xmalloc(sizeof(CFGNode *) * (numNode + 1));
+
+	/* Leaders first, then whatever is left in leaderless cycles */
+	for (pass=0; pass<2; pass++) {
+		for (i=0; i<numNode; i++) {
+			CFGNode *ptr = pCtx->nodeTable[i];
+			BasicBlock *pBlock;
+
+			if (ptr->pBlock || (pass == 0 && !leader[i]))
+				continue;
+
+			leader[i] = true;
+			pBlock = &pCtx->blockTable[numBlock];
+			pBlock->id = numBlock++;
+			pBlock->first = num;
+
+			for (;;) {
+				pCtx->blockNodes[num++] = ptr;
+				ptr->pBlock = pBlock;
+
+				if (ptr->nType == NTBIND)
+					pBlock->hasBind = true;
+
+				if (ptr->succNum != 1 || leader[ptr->succs[0]->id] || 
+					ptr->succs[0]->pBlock)
+					break;
+
+				ptr = ptr->succs[0];
+			}
+
+			pBlock->nodeNum = num - pBlock->first;
+		}
+	}
+
+	assert(num == numNode);
+	pCtx->numBlock = numBlock;
+
+	/* Every edge between blocks leaves a last node and enters a first */
+	for (i=0; i<numBlock; i++) {
+		BasicBlock *pBlock = &pCtx->blockTable[i];
+		CFGNode *pLast = pCtx->blockNodes[pBlock->first + pBlock->nodeNum - 1];
+
+		pBlock->succNum = pLast->succNum;
+		numEdge += pBlock->succNum;
+	}
+
+	pCtx->blockSuccPool = 
+		(BasicBlock **) xmalloc(sizeof(BasicBlock *) * (numEdge + 1));
+	pSucc = pCtx->blockSuccPool;
+
+	for (i=0; i<numBlock; i++) {
+		BasicBlock *pBlock = &pCtx->blockTable[i];
+		CFGNode *pLast = pCtx->blockNodes[pBlock->first + pBlock->nodeNum - 1];
+
+		pBlock->succs = pSucc;
+		pSucc += pBlock->succNum;
+
+		for (j=0; j<pBlock->succNum; j++)
+			pBlock->succs[j] = pLast->succs[j]->pBlock;
 	}
 
-	return false;
+	free(leader);
 }
 
-/* 
- * Get the in set from a successor node. For memory space,
- * we consider {in} as {in} U {use}.
+/*
+ * Number the blocks in reverse postorder. A depth-first search from
+ * the entry emits every block after its successors (postorder), and
+ * the emitted block takes the highest free index. Blocks not
+ * reachable from the entry are numbered the same way.
  */
-int getSucIn(CFGNode *pCur, CFGNode *pSuc)
+static void buildOrder(AnalysisCtx *pCtx, CFGNode *pEntry)
 {
-	Operand *ptr;
-	int inNum = 0;
+	int numBlock = pCtx->numBlock;
+	BasicBlock **stack = 
+		(BasicBlock **) xmalloc(sizeof(BasicBlock *) * (numBlock + 1));
+	int *nextSuc = (int *) xcalloc(numBlock + 1, sizeof(int));
+	bool *visited = (bool *) xcalloc(numBlock + 1, sizeof(bool));
+	int top, num = numBlock;
+	int i;
 
-	if (!pSuc)
-		return 0;
+	for (i=-1; i<numBlock; i++) {
+		BasicBlock *pRoot;
+		
+		if (i < 0)
+			pRoot = pEntry ? pEntry->pBlock : NULL;
+		else
+			pRoot = &pCtx->blockTable[i];
 
-	/*
-	 * Scan for current successor's use set duplicate in 
-	 * current node's out and successors' in.
-	 */
-	for (ptr=pSuc->useOp; ptr; ptr=ptr->next) {
-		if (checkSetDup(ptr, gSucIn, sInNum) || 
-			checkListDup(ptr, pCur->out)) 
-		{
+		if (!pRoot || visited[pRoot->id])
 			continue;
-		} else {
-			gSucIn[sInNum + inNum] = ptr;
-			inNum++;
+
+		visited[pRoot->id] = true;
+		stack[0] = pRoot;
+		top = 1;
+
+		while (top) {
+			BasicBlock *ptr = stack[top - 1];
+
+			if (nextSuc[ptr->id] < ptr->succNum) {
+				BasicBlock *pSuc = ptr->succs[nextSuc[ptr->id]++];
+
+				if (!visited[pSuc->id]) {
+					visited[pSuc->id] = true;
+					stack[top++] = pSuc;
+				}
+			} else {
+				ptr->rpo = --num;
+				pCtx->frozen.blocks[num] = ptr;
+				top--;
+			}
+		}
+	}
+
+	assert(num == 0);
+
+	free(stack);
+	free(nextSuc);
+	free(visited);
+}
+
+/*
+ * Lay the block graph out for the solver: CSR successor and
+ * predecessor lists in reverse postorder, and the in, out, use and def
+ * rows of all blocks in one zeroed pool. The use and def rows sum up
+ * every block from its last node backward:
+ * use = use_i | (use & ~def_i), def = def | def_i
+ */
+static void freezeCFG(AnalysisCtx *pCtx)
+{
+	FrozenCFG *pCfg = &pCtx->frozen;
+	int numBlock = pCtx->numBlock;
+	int setWords = pCtx->setWords;
+	int numEdge = 0;
+	int *predNum;
+	int i, j;
+
+	pCfg->numBlock = numBlock;
+
+	pCfg->succStart = (int *) xmalloc(sizeof(int) * (numBlock + 1));
+	for (i=0; i<numBlock; i++) {
+		pCfg->succStart[i] = numEdge;
+		numEdge += pCfg->blocks[i]->succNum;
+	}
+	pCfg->succStart[numBlock] = numEdge;
+
+	pCfg->succIdx = (int *) xmalloc(sizeof(int) * (numEdge + 1));
+	pCfg->predIdx = (int *) xmalloc(sizeof(int) * (numEdge + 1));
+	pCfg->predStart = (int *) xcalloc(numBlock + 1, sizeof(int));
+	predNum = (int *) xcalloc(numBlock + 1, sizeof(int));
+
+	for (i=0; i<numBlock; i++) {
+		BasicBlock *pBlock = pCfg->blocks[i];
+
+		for (j=0; j<pBlock->succNum; j++) {
+			int suc = pBlock->succs[j]->rpo;
+
+			pCfg->succIdx[pCfg->succStart[i] + j] = suc;
+			predNum[suc]++;
 		}
 	}
-	
-	/*
-	 * Scan for current successor's in set duplicate in 
-	 * current node's out and successors' in.
+
+	for (i=0; i<numBlock; i++)
+		pCfg->predStart[i + 1] = pCfg->predStart[i] + predNum[i];
+
+	/* Predecessors come out in reverse postorder as well */
+	memset(predNum, 0, sizeof(int) * numBlock);
+	for (i=0; i<numBlock; i++) {
+		for (j=pCfg->succStart[i]; j<pCfg->succStart[i + 1]; j++) {
+			int suc = pCfg->succIdx[j];
+
+			pCfg->predIdx[pCfg->predStart[suc] + predNum[suc]++] = i;
+		}
+	}
+
+	free(predNum);
+
+	pCfg->setPool = (BitWord *) xcalloc(
+		(size_t) numBlock * 4 * setWords + 1, sizeof(BitWord));
+	pCfg->in = pCfg->setPool;
+	pCfg->out = pCfg->in + (size_t) numBlock * setWords;
+	pCfg->useSet = pCfg->out + (size_t) numBlock * setWords;
+	pCfg->defSet = pCfg->useSet + (size_t) numBlock * setWords;
+
+	for (i=0; i<numBlock; i++) {
+		BasicBlock *pBlock = pCfg->blocks[i];
+		BitWord *pUse = pCfg->useSet + (size_t) i * setWords;
+		BitWord *pDef = pCfg->defSet + (size_t) i * setWords;
+
+		for (j=pBlock->first+pBlock->nodeNum-1; j>=pBlock->first; j--) {
+			CFGNode *ptr = pCtx->blockNodes[j];
+
+			bitTransfer(pUse, ptr->useSet, pUse, ptr->defSet, setWords);
+			bitOr(pDef, ptr->defSet, setWords);
+		}
+	}
+}
+
+/* Initialization */
+void initDFA(AnalysisCtx *pCtx)
+{
+	CFGNode *ptr;
+	int i, numNode;
+
+	/* 
+	 * Initialize bind table and give every node an id. Nodes may come
+	 * from an earlier run (cfgload), so their block is reset as well.
 	 */
-	for (ptr=pSuc->in; ptr; ptr=ptr->next) {
-		if (checkSetDup(ptr, gSucIn, sInNum) || 
-			checkListDup(ptr, pCur->out)) 
-		{
-			continue;
-		} else {
-			gSucIn[sInNum + inNum] = ptr;
-			inNum++;
+	pCtx->bindTable = 
+		(CFGNode **) xmalloc(sizeof(CFGNode *) * pCtx->numBindNode);
+	for (i=0, numNode=0, ptr=pCtx->cfgList; ptr; ptr=ptr->nextCFG) {
+		if (ptr->nType == NTBIND) {
+			pCtx->bindTable[i++] = ptr;
 		}
+		ptr->id = numNode++;
+		ptr->pBlock = NULL;
+	}
+	pCtx->numNode = numNode;
+
+	pCtx->nodeTable = (CFGNode **) xmalloc(sizeof(CFGNode *) * (numNode + 1));
+	for (ptr=pCtx->cfgList; ptr; ptr=ptr->nextCFG)
+		pCtx->nodeTable[ptr->id] = ptr;
+
+	buildEdges(pCtx);
+	pCtx->setWords = BITSET_WORDS(pCtx->varNum);
+}
+
+/* Blocks, their order and the sets of the dense solver */
+static void initDense(AnalysisCtx *pCtx, CFGNode *pEntry)
+{
+	int setWords = pCtx->setWords;
+	CFGNode *ptr;
+	BitWord *pSet;
+	Operand *pOp;
+
+	buildBlocks(pCtx, pEntry);
+
+	pCtx->frozen.blocks = 
+		(BasicBlock **) xmalloc(sizeof(BasicBlock *) * (pCtx->numBlock + 1));
+	buildOrder(pCtx, pEntry);
+
+	/* Carve def, use, in and out sets of every node out of one pool */
+	pCtx->setPool = (BitWord *) xcalloc(
+		(size_t) pCtx->numNode * 4 * setWords + 1, sizeof(BitWord));
+	pSet = pCtx->setPool;
+
+	for (ptr=pCtx->cfgList; ptr; ptr=ptr->nextCFG) {
+		ptr->defSet = pSet;
+		ptr->useSet = pSet + setWords;
+		ptr->in = pSet + setWords * 2;
+		ptr->out = pSet + setWords * 3;
+		pSet += setWords * 4;
+
+		for (pOp=ptr->defOp; pOp; pOp=pOp->next)
+			bitSet(ptr->defSet, pOp->id);
+		for (pOp=ptr->useOp; pOp; pOp=pOp->next)
+			bitSet(ptr->useSet, pOp->id);
+	}
+
+	freezeCFG(pCtx);
+}
+
+/* Sift a heap entry down, the heap is ordered by postorder rank */
+static void heapDown(int *heap, int num, int pos)
+{
+	int val = heap[pos];
+
+	while (pos * 2 + 1 < num) {
+		int child = pos * 2 + 1;
+
+		if (child + 1 < num && heap[child + 1] < heap[child])
+			child++;
+		if (heap[child] >= val)
+			break;
+
+		heap[pos] = heap[child];
+		pos = child;
+	}
+
+	heap[pos] = val;
+}
+
+static void heapUp(int *heap, int pos)
+{
+	int val = heap[pos];
+
+	while (pos && heap[(pos - 1) / 2] > val) {
+		heap[pos] = heap[(pos - 1) / 2];
+		pos = (pos - 1) / 2;
+	}
+
+	heap[pos] = val;
+}
+
+/*
+ * Grow the solver scratch for numBlock blocks and sets of setWords
+ * words. It belongs to the context and is only freed with it, so once
+ * the largest function so far has been solved, the next ones run
+ * without allocating a work list or a union set.
+ */
+static void growScratch(AnalysisCtx *pCtx, int numBlock, int setWords)
+{
+	if (setWords > pCtx->sucInCap) {
+		pCtx->sucInCap = setWords;
+		pCtx->sucIn = (BitWord *) 
+			xrealloc(pCtx->sucIn, sizeof(BitWord) * pCtx->sucInCap);
 	}
 
-	return inNum;
+	if (numBlock + 1 > pCtx->dfaHeapCap) {
+		pCtx->dfaHeapCap = pCtx->dfaHeapCap ? pCtx->dfaHeapCap : 256;
+		while (pCtx->dfaHeapCap < numBlock + 1)
+			pCtx->dfaHeapCap <<= 1;
+		pCtx->dfaHeap = (int *) 
+			xrealloc(pCtx->dfaHeap, sizeof(int) * pCtx->dfaHeapCap);
+		pCtx->dfaOnList = (bool *) 
+			xrealloc(pCtx->dfaOnList, sizeof(bool) * pCtx->dfaHeapCap);
+	}
 }
 
-/* Generate the in set and out set from gSucIn */
-void genInOut(CFGNode *pCur)
+/* 
+ * Running DFA analysis. This is a worklist solver over the frozen
+ * block graph: all blocks are seeded in postorder, and a block whose
+ * in set changes puts its predecessors back on the list. The list is
+ * a heap keyed by postorder rank, so a predecessor later in the order
+ * is still handled in the current pass. Every block is on it at most
+ * once.
+ */
+void beginDFA(AnalysisCtx *pCtx)
 {
-	bool inChange = false;
+	FrozenCFG *pCfg = &pCtx->frozen;
+	int numBlock = pCfg->numBlock;
+	int setWords = pCtx->setWords;
+	BitWord *sucIn;
+	int *heap;
+	bool *onList;
+	int heapNum, lastRank;
 	int i;
 
-	for (i=0; i<sInNum; i++) {
-		/* 
-		 * Checked with current out before, so add it to cur out
-		 * directly.
-		 */
-		Operand *pOut = newOperand(gSucIn[i]->name, NULL);
+	growScratch(pCtx, numBlock, setWords);
+	sucIn = pCtx->sucIn;
+	heap = pCtx->dfaHeap;
+	onList = pCtx->dfaOnList;
+
+	/* Postorder rank of block i is numBlock - 1 - i */
+	for (i=0; i<numBlock; i++) {
+		heap[i] = i;
+		onList[i] = true;
+	}
+	heapNum = numBlock;
+
+	/* Every pass over the postorder counts as one iteration */
+	pCtx->dfaVisitNum = 0;
+	pCtx->dfaIterNum = 0;
+	pCtx->dfaUnionNum = 0;
+	lastRank = numBlock;
+
+	while (heapNum) {
+		int cur = numBlock - 1 - heap[0];
+		BitWord *pOut = pCfg->out + (size_t) cur * setWords;
+
+		if (heap[0] <= lastRank)
+			pCtx->dfaIterNum++;
+		lastRank = heap[0];
 
-		if (pCur->out)
-			pOut->next = pCur->out;
-		pCur->out = pOut;
+		heap[0] = heap[--heapNum];
+		heapDown(heap, heapNum, 0);
+		onList[cur] = false;
+		pCtx->dfaVisitNum++;
 
-		if (!checkListDup(gSucIn[i], pCur->defOp) &&
-			!checkListDup(gSucIn[i], pCur->useOp) && 
-			!checkListDup(gSucIn[i], pCur->in)) 
+		bitZero(sucIn, setWords);
+		pCtx->dfaUnionNum += pCfg->succStart[cur + 1] - pCfg->succStart[cur];
+		for (i=pCfg->succStart[cur]; i<pCfg->succStart[cur + 1]; i++) {
+			bitOr(sucIn, pCfg->in + (size_t) pCfg->succIdx[i] * setWords, 
+				setWords);
+		}
+
+		/* in = use | (out & ~def) */
+		bitCopy(pOut, sucIn, setWords);
+		if (bitTransfer(pCfg->in + (size_t) cur * setWords, 
+			pCfg->useSet + (size_t) cur * setWords, pOut, 
+			pCfg->defSet + (size_t) cur * setWords, setWords))
 		{
-			Operand *pIn = newOperand(gSucIn[i]->name, NULL);
-			if (pCur->in)
-				pIn->next = pCur->in;
-			pCur->in = pIn;
+			for (i=pCfg->predStart[cur]; i<pCfg->predStart[cur + 1]; i++) {
+				int pred = pCfg->predIdx[i];
+
+				if (!onList[pred]) {
+					onList[pred] = true;
+					heap[heapNum] = numBlock - 1 - pred;
+					heapUp(heap, heapNum++);
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Hand the solved block sets back to the nodes: the in set of a block
+ * goes to its first node and the out set to its last one. The sets of
+ * the nodes inside are recovered from there, walking the nodes
+ * backward. finDFA needs them for bind nodes, and the CFG dump prints
+ * all of them.
+ */
+static void recoverNodes(AnalysisCtx *pCtx)
+{
+	FrozenCFG *pCfg = &pCtx->frozen;
+	int setWords = pCtx->setWords;
+	bool all = TRACE_ON(TRACE_CFG);
+	int i, j;
+
+	for (i=0; i<pCfg->numBlock; i++) {
+		BasicBlock *pBlock = pCfg->blocks[i];
+		int last = pBlock->first + pBlock->nodeNum - 1;
+
+		bitCopy(pCtx->blockNodes[pBlock->first]->in, 
+			pCfg->in + (size_t) i * setWords, setWords);
+		bitCopy(pCtx->blockNodes[last]->out, 
+			pCfg->out + (size_t) i * setWords, setWords);
+
+		if (pBlock->nodeNum == 1 || !(all || pBlock->hasBind))
+			continue;
+
+		for (j=last; j>=pBlock->first; j--) {
+			CFGNode *ptr = pCtx->blockNodes[j];
+
+			if (j != last)
+				bitCopy(ptr->out, pCtx->blockNodes[j + 1]->in, setWords);
+			bitTransfer(ptr->in, ptr->useSet, ptr->out, ptr->defSet, 
+				setWords);
 		}
 	}
 }
 
-/* Running DFA analysis */
-void beginDFA(CFGNode *dfaList)
+/* 
+ * Group the nodes referring to every variable, CSR style: the nodes of
+ * variable v are pIdx[pStart[v] .. pStart[v + 1] - 1]. A node shows up
+ * once per operand.
+ */
+static void sparseIndex(AnalysisCtx *pCtx, bool isDef, int **pStart, 
+	int **pIdx)
 {
+	int varNum = pCtx->varNum;
+	int *start = (int *) xcalloc(varNum + 2, sizeof(int));
+	int *idx;
 	CFGNode *ptr;
-	bool converge;
-
-	do {
-		ptr = dfaList;
-		converge = true;
-
-		for (ptr=dfaList; ptr; ptr=ptr->nextCFG) {
-	
-			sInNum = 0;
-			
-			switch (ptr->nType) {
-				case NTIF:
-					sInNum += getSucIn(ptr, ptr->bTrue);
-					sInNum += getSucIn(ptr, ptr->bFalse);
-					break;
-				case NTSWITCH:
-					{
-						if (ptr->next && ptr->next->nType == NTBIND) {
-							sInNum = getSucIn(ptr, ptr->next);
-						} else {
-							int i;
-
-							for (i=0; i<ptr->caseNum; i++) {
-								sInNum += getSucIn(ptr, ptr->caseTable[i]);
-							}
-						}
-					}
-					break;
-				case NTBIND:
-					if (ptr->caseTable) {
-						int i;
+	Operand *pOp;
+	int i;
 
-						for (i=0; i<ptr->caseNum; i++) {
-							sInNum += getSucIn(ptr, ptr->caseTable[i]);
-						}
-					} else {
-						sInNum = getSucIn(ptr, ptr->next);
+	for (ptr=pCtx->cfgList; ptr; ptr=ptr->nextCFG) {
+		for (pOp=isDef ? ptr->defOp : ptr->useOp; pOp; pOp=pOp->next)
+			start[pOp->id + 2]++;
+	}
 
-					}
-					break;
-				case NTGOTO:
-				case NTLABEL:
-				case NTNORMAL:
-					sInNum = getSucIn(ptr, ptr->next);
-					break;
+	for (i=2; i<varNum+2; i++)
+		start[i] += start[i - 1];
+
+	idx = (int *) xmalloc(sizeof(int) * (start[varNum + 1] + 1));
+
+	/* start[v + 1] runs from the first slot of v to the first of v + 1 */
+	for (ptr=pCtx->cfgList; ptr; ptr=ptr->nextCFG) {
+		for (pOp=isDef ? ptr->defOp : ptr->useOp; pOp; pOp=pOp->next)
+			idx[start[pOp->id + 1]++] = ptr->id;
+	}
+
+	*pStart = start;
+	*pIdx = idx;
+}
+
+/*
+ * Sparse liveness, one variable at a time. A variable is live into
+ * every node that reaches one of its uses backward without passing a
+ * node defining it, which is the fixed point the dense solver reaches
+ * as well. The walk starts at the uses, and the cost follows the
+ * def-use paths instead of nodes times variables. Only bind nodes get
+ * in and out sets, since that is all finDFA reads, unless the CFG is
+ * traced and the dump wants every node.
+ */
+static void sparseDFA(AnalysisCtx *pCtx)
+{
+	int numNode = pCtx->numNode;
+	int setWords = pCtx->setWords;
+	bool all = TRACE_ON(TRACE_CFG);
+	int *useStart, *useIdx, *defStart, *defIdx;
+	int *predStart, *predIdx;
+	int *defMark, *inMark, *outMark, *stack;
+	BitWord **inSet, **outSet;
+	CFGNode *ptr;
+	BitWord *pSet;
+	int setNum, numEdge, v, i;
+
+	setNum = all ? numNode : pCtx->numBindNode;
+	pCtx->setPool = (BitWord *) xcalloc(
+		(size_t) setNum * 2 * setWords + 1, sizeof(BitWord));
+	pSet = pCtx->setPool;
+
+	/* 
+	 * The walk reads only the arrays below, indexed by node id, and
+	 * leaves the nodes themselves alone.
+	 */
+	inSet = (BitWord **) xcalloc(numNode + 1, sizeof(BitWord *));
+	outSet = (BitWord **) xcalloc(numNode + 1, sizeof(BitWord *));
+	predStart = (int *) xmalloc(sizeof(int) * (numNode + 1));
+	for (numEdge=0, ptr=pCtx->cfgList; ptr; ptr=ptr->nextCFG)
+		numEdge += ptr->predNum;
+	predIdx = (int *) xmalloc(sizeof(int) * (numEdge + 1));
+
+	for (i=0, ptr=pCtx->cfgList; ptr; ptr=ptr->nextCFG) {
+		int j;
+
+		if (all || ptr->nType == NTBIND) {
+			ptr->in = inSet[ptr->id] = pSet;
+			ptr->out = outSet[ptr->id] = pSet + setWords;
+			pSet += setWords * 2;
+		}
+
+		predStart[ptr->id] = i;
+		for (j=0; j<ptr->predNum; j++)
+			predIdx[i++] = ptr->preds[j]->id;
+	}
+	predStart[numNode] = i;
+
+	sparseIndex(pCtx, false, &useStart, &useIdx);
+	sparseIndex(pCtx, true, &defStart, &defIdx);
+
+	/* Marks hold v + 1 for the variable walked last, no clearing */
+	defMark = (int *) xcalloc(numNode + 1, sizeof(int));
+	inMark = (int *) xcalloc(numNode + 1, sizeof(int));
+	outMark = (int *) xcalloc(numNode + 1, sizeof(int));
+	stack = (int *) xmalloc(sizeof(int) * (numNode + 1));
+
+	pCtx->dfaIterNum = 0;
+	pCtx->dfaVisitNum = 0;
+	pCtx->dfaUnionNum = 0;
+
+	for (v=0; v<pCtx->varNum; v++) {
+		int mark = v + 1;
+		int top = 0;
+
+		if (useStart[v] == useStart[v + 1])
+			continue;
+
+		pCtx->dfaIterNum++;
+
+		for (i=defStart[v]; i<defStart[v + 1]; i++)
+			defMark[defIdx[i]] = mark;
+
+		/* in = use | (out & ~def) */
+		for (i=useStart[v]; i<useStart[v + 1]; i++) {
+			int id = useIdx[i];
+
+			if (inMark[id] != mark) {
+				inMark[id] = mark;
+				stack[top++] = id;
 			}
+		}
+
+		while (top) {
+			int cur = stack[--top];
+
+			pCtx->dfaVisitNum++;
+			if (inSet[cur])
+				bitSet(inSet[cur], v);
+
+			for (i=predStart[cur]; i<predStart[cur + 1]; i++) {
+				int id = predIdx[i];
+
+				if (outMark[id] == mark)
+					continue;
+
+				outMark[id] = mark;
+				pCtx->dfaUnionNum++;
+				if (outSet[id])
+					bitSet(outSet[id], v);
+
+				if (defMark[id] != mark && inMark[id] != mark) {
+					inMark[id] = mark;
+					stack[top++] = id;
+				}
+			}
+		}
+	}
+
+	free(useStart);
+	free(useIdx);
+	free(defStart);
+	free(defIdx);
+	free(predStart);
+	free(predIdx);
+	free(inSet);
+	free(outSet);
+	free(defMark);
+	free(inMark);
+	free(outMark);
+	free(stack);
+}
+
+/* 
+ * Pick the liveness engine. The dense solver touches whole sets, a
+ * word per 64 variables, so it wins while the sets are small. With
+ * many variables the sets are mostly zero and the sparse walk, which
+ * only follows def-use paths, is cheaper both in time and in memory.
+ * A variable used but never defined is the exception: it is live up
+ * to the entry and its walk covers the whole graph, so the sparse
+ * engine is only picked when few variables are like that.
+ */
+static bool useSparse(AnalysisCtx *pCtx)
+{
+	int varNum = pCtx->varNum;
+	char *seen;
+	int usedNum = 0, undefNum = 0;
+	CFGNode *ptr;
+	Operand *pOp;
+	int i;
 
-			if (sInNum) {
-				converge = false;
-				genInOut(ptr);
-			} 
+	if (gDfaEngine != DFA_AUTO)
+		return gDfaEngine == DFA_SPARSE;
+
+	if (varNum < SPARSE_MIN_VARS)
+		return false;
+
+	/* Bit 0 for a use of the variable, bit 1 for a def */
+	seen = (char *) xcalloc(varNum + 1, sizeof(char));
+	for (ptr=pCtx->cfgList; ptr; ptr=ptr->nextCFG) {
+		for (pOp=ptr->useOp; pOp; pOp=pOp->next)
+			seen[pOp->id] |= 1;
+		for (pOp=ptr->defOp; pOp; pOp=pOp->next)
+			seen[pOp->id] |= 2;
+	}
+
+	for (i=0; i<varNum; i++) {
+		if (seen[i] & 1) {
+			usedNum++;
+			if (!(seen[i] & 2))
+				undefNum++;
 		}
-	} while (!converge);
+	}
+
+	free(seen);
+
+	return undefNum * SPARSE_UNDEF_RATIO <= usedNum;
 }
 
-void handleOut(char *bindID, int order, char *name)
+void handleOut(AnalysisCtx *pCtx, CFGNode *pBind, int order, char *name)
 {
-	out[outNum].bindID = bindID;
-	out[outNum].order = order;
-	out[outNum].name = name;
-	outNum++;
+	Output *pOut;
+
+	if (pCtx->outNum == pCtx->outCap) {
+		pCtx->outCap = pCtx->outCap ? pCtx->outCap << 1 : 64;
+		pCtx->out = (Output *) 
+			xrealloc(pCtx->out, sizeof(Output) * pCtx->outCap);
+	}
+
+	pOut = &pCtx->out[pCtx->outNum++];
+
+	pOut->pBind = pBind;
+	pOut->order = order;
+	pOut->name = name;
 }
 
 /* 
- * Do final analysis on all bind scopes and 
- * print out all uninitialized variables. 
- * For all elements in out set, check whether it is
- * in the in set. If yes, we have to check whether
- * it is declared in this scope. If yes, then it
- * is an uninitialized but used variable.
+ * Print out all uninitialized variables. A variable declared in a
+ * bind is uninitialized but used if it is live both into and out of
+ * the bind: the bind defines nothing, so the value comes from before
+ * the declaration. Every variable knows its declaring bind and decl
+ * index since it was interned, so this is one bit test per variable.
  */
-void finDFA(FILE *file, int numBind, char *funcName)
+void finDFA(AnalysisCtx *pCtx, FILE *file, char *funcName)
 {
+	Output *out;
 	int i;
 
-	for (i=0, outNum=0; i<numBind; i++) {
-		CFGNode *pBind = bindTable[i];
-		Operand *pOut = pBind->out;
-
-		while (pOut) {
-			if (checkListDup(pOut, pBind->in) || 
-				checkListDup(pOut, pBind->useOp)) 
-			{
-				/* 
-				 * Operand occurs in and out sets, check
-				 * for declaration
-				 */
-				tree decl = pBind->decls;
-				int j;
-
-				for (j=0; decl; decl=DECL_CHAIN(decl), j++) {
-					if (TREE_CODE(decl) == VAR_DECL) {
-						sprintf(tmpBuf, "%s%s-%d", 
-							IDENTIFIER_POINTER((DECL_NAME(decl))),
-							pBind->bindID, j);
-						
-						if (strcmp(tmpBuf, pOut->name) == 0) {
-							handleOut(pBind->bindID, j, 
-								IDENTIFIER_POINTER((DECL_NAME(decl))));
-							break;
-						}
-					}
-				}
-			}
-			pOut = pOut->next;
+	for (i=0, pCtx->outNum=0; i<pCtx->varNum; i++) {
+		Variable *pVar = pCtx->varList[i];
+		CFGNode *pBind = pVar->pBind;
+
+		if (pBind && bitTest(pBind->in, i) && bitTest(pBind->out, i)) {
+			handleOut(pCtx, pBind, pVar->declIdx, 
+				IDENTIFIER_POINTER(DECL_NAME(pVar->decl)));
 		}
 	}
 
-	if (!outNum)
+	if (!pCtx->outNum)
 		return;
 
-	qsort(out, outNum, sizeof(struct Output), cmpFunc);
+	/* handleOut() may have moved the table */
+	out = pCtx->out;
+	if (pCtx->outNum > 1)
+		rankScopes(pCtx);
+	qsort(out, pCtx->outNum, sizeof(Output), cmpFunc);
 
-	fprintf(file, "%s:%s", funcName, out[0].name);
-	for (i=1; i<outNum; i++) {
-		fprintf(file, ",%s", out[i].name);
+	if (gOutputMode == OUTPUT_JSONL) {
+		fprintf(file, "{\"function\": \"%s\", \"uninit\": [", funcName);
+		for (i=0; i<pCtx->outNum; i++) {
+			fprintf(file, "%s{\"name\": \"%s\", \"bind\": \"", 
+				i ? ", " : "", out[i].name);
+			printScope(file, out[i].pBind);
+			fprintf(file, "\", \"decl\": %d}", out[i].order);
+		}
+		fputs("]}\n", file);
+		return;
+	}
+
+	fputs(funcName, file);
+	for (i=0; i<pCtx->outNum; i++) {
+		putc(i ? ',' : ':', file);
+		fputs(out[i].name, file);
+	}
+	putc('\n', file);
+}
+
+/* Most members in any of rows sets laid out one after another */
+static int peakSet(BitWord *pool, long rows, int setWords)
+{
+	int peak = 0;
+	long i;
+
+	for (i=0; i<rows; i++) {
+		int num = bitCount(pool + i * setWords, setWords);
+
+		if (num > peak)
+			peak = num;
+	}
+
+	return peak;
+}
+
+/* Solver counters of the function, see stats.h */
+static void statsDFA(AnalysisCtx *pCtx, bool sparse)
+{
+	FuncStats *pStats = &pCtx->stats;
+	FrozenCFG *pCfg = &pCtx->frozen;
+
+	pStats->sparse = sparse;
+	pStats->nodeNum = pCtx->numNode;
+	pStats->bindNum = pCtx->numBindNode;
+	pStats->varNum = pCtx->varNum;
+	pStats->blockNum = sparse ? 0 : pCtx->numBlock;
+	pStats->iterNum = pCtx->dfaIterNum;
+	pStats->visitNum = pCtx->dfaVisitNum;
+	pStats->unionNum = pCtx->dfaUnionNum;
+	pStats->setWords = pCtx->setWords;
+
+	/* The sets the solver filled: block rows, or the sparse node sets */
+	if (sparse) {
+		pStats->peakSet = peakSet(pCtx->setPool, 2L * 
+			(TRACE_ON(TRACE_CFG) ? pCtx->numNode : pCtx->numBindNode),
+			pCtx->setWords);
+	} else {
+		/* The out rows follow the in rows */
+		pStats->peakSet = peakSet(pCfg->in, 2L * pCfg->numBlock, 
+			pCtx->setWords);
+	}
+}
+
+void doDFA(AnalysisCtx *pCtx, FILE *file, CFGNode *pEntry, char *funcName)
+{
+	double mark = 0;
+	bool sparse;
+
+	if (STATS_ON())
+		mark = statsNow();
+
+	initDFA(pCtx);
+	sparse = useSparse(pCtx);
+
+	if (!sparse)
+		initDense(pCtx, pEntry);
+
+	if (STATS_ON())
+		statsLap(&pCtx->stats, PHASE_INIT, &mark);
+
+	perfStart(&pCtx->perf);
+	if (sparse)
+		sparseDFA(pCtx);
+	else
+		beginDFA(pCtx);
+	perfStop(&pCtx->perf);
+
+	if (STATS_ON()) {
+		statsLap(&pCtx->stats, PHASE_SOLVE, &mark);
+		statsDFA(pCtx, sparse);
+		mark = statsNow();
 	}
-	fprintf(file, "\n");
+
+	if (!sparse)
+		recoverNodes(pCtx);
+	finDFA(pCtx, file, funcName);
+
+	if (STATS_ON())
+		statsLap(&pCtx->stats, PHASE_FINISH, &mark);
+
+	if (TRACE_ON(TRACE_CFG))
+		buildLoops(pCtx, pEntry);
+
+	if (TRACE_ON(TRACE_CFG) && sparse) {
+		fprintf(pCtx->traceFile, 
+			"%s: %d nodes, sparse liveness of %d variables, "
+			"%d path steps\n", funcName, pCtx->numNode, pCtx->dfaIterNum, 
+			pCtx->dfaVisitNum);
+		perfReport(&pCtx->perf, pCtx->traceFile, funcName);
+	} else if (TRACE_ON(TRACE_CFG)) {
+		fprintf(pCtx->traceFile, 
+			"%s: %d nodes in %d blocks, DFA converged after %d iterations, "
+			"%d block visits\n", funcName, pCtx->numNode, pCtx->numBlock, 
+			pCtx->dfaIterNum, pCtx->dfaVisitNum);
+		perfReport(&pCtx->perf, pCtx->traceFile, funcName);
+	}
+
+	if (TRACE_ON(TRACE_CFG)) {
+		fprintf(pCtx->traceFile, "%s: %d natural loops, nested %d deep\n", 
+			funcName, pCtx->loopNum, pCtx->loopMaxDepth);
+	}
+}
+
+/* Release DFA state, the sets stay valid until this call */
+void freeDFA(AnalysisCtx *pCtx)
+{
+	free(pCtx->bindTable);
+	free(pCtx->setPool);
+	free(pCtx->succPool);
+	free(pCtx->predPool);
+	free(pCtx->nodeTable);
+	free(pCtx->blockTable);
+	free(pCtx->blockNodes);
+	free(pCtx->blockSuccPool);
+	free(pCtx->frozen.blocks);
+	free(pCtx->frozen.succStart);
+	free(pCtx->frozen.succIdx);
+	free(pCtx->frozen.predStart);
+	free(pCtx->frozen.predIdx);
+	free(pCtx->frozen.setPool);
+	pCtx->bindTable = NULL;
+	pCtx->setPool = NULL;
+	pCtx->succPool = pCtx->predPool = NULL;
+	pCtx->nodeTable = NULL;
+	pCtx->blockTable = NULL;
+	pCtx->blockNodes = NULL;
+	pCtx->blockSuccPool = NULL;
+	memset(&pCtx->frozen, 0, sizeof(FrozenCFG));
 }
 
-void doDFA(FILE *file, CFGNode *dfaList, int numBind, char *funcName)
+/* Release the solver scratch and findings, with the context */
+void freeDFAScratch(AnalysisCtx *pCtx)
 {
-	initDFA(dfaList, numBind);
-	beginDFA(dfaList);
-	finDFA(file, numBind, funcName);
+	free(pCtx->sucIn);
+	free(pCtx->dfaHeap);
+	free(pCtx->dfaOnList);
+	free(pCtx->out);
+	pCtx->sucIn = NULL;
+	pCtx->dfaHeap = NULL;
+	pCtx->dfaOnList = NULL;
+	pCtx->out = NULL;
+	pCtx->sucInCap = pCtx->dfaHeapCap = pCtx->outCap = 0;
 }
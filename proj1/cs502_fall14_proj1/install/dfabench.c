@@ -0,0 +1,655 @@
+/*
+ * Solver benchmark on synthetic CFGs. Generates functions shaped like
+ * the ones walkStmt builds (statements, if/else, loops closed by a
+ * goto, switches with fall-through, nested binds declaring scoped
+ * variables) and runs doDFA on them, without gcc. Variables are
+ * interned by internVar() of variable.c, as in csproj2.c.
+ *
+ * Build with "make dfabench", run as
+ *     ./dfabench [-f funcs] [-n nodes] [-l loop depth] [-s fan-out]
+ *                [-b bind depth] [-v vars per bind] [-r rounds]
+ *                [-x seed] [-e dense|sparse|auto] [-j rate] [-p] [-c]
+ * -p prints the output.txt lines of the first round to stdout. -c runs
+ * buildLoops() on every function and checks its dominators against a
+ * second algorithm and its loop depths against the generator. -j makes
+ * rate percent of the statements branch back to some earlier label,
+ * which gives unstructured and irreducible cycles; only dominators are
+ * checked then. Wide switches over many live variables, e.g. -s 2000
+ * -v 64, stress the successor unions of the solver.
+ */
+#include <stdio.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "csproj2.h"
+
+typedef struct BenchParams {
+	int funcNum;
+	int nodeNum;
+	int loopDepth;
+	int fanOut;
+	int bindDepth;
+	int varNum;
+	int rounds;
+	unsigned long seed;
+	int jumpRate;
+	bool print;
+	bool check;
+} BenchParams;
+
+/* Generator state of one function */
+typedef struct Gen {
+	BenchParams *pParams;
+	AnalysisCtx *pCtx;
+	CFGNode *pTail;
+	CFGNode *pBind;
+	/* Ids of the variables in scope, innermost last */
+	int *visible;
+	int visNum;
+	int visCap;
+	int loopDepth;
+	/* Loop depth of every node when it was made, by node id */
+	int *nodeDepth;
+	int nodeCap;
+	/* Labels made so far, targets of -j */
+	CFGNode **labels;
+	int labelNum;
+	int labelCap;
+	int bindDepth;
+	/* Statements around the current one */
+	int depth;
+	/* Nodes still to generate */
+	int budget;
+	unsigned long rng;
+} Gen;
+
+static const char *names[] = {
+	"i", "j", "n", "len", "tmp", "count", "sum", "buf", "p", "x", "y", "z",
+};
+#define NAME_NUM ((int) (sizeof(names) / sizeof(names[0])))
+
+/* Ifs and switches nest no deeper than this */
+#define MAX_NEST 24
+
+static unsigned int rnd(Gen *g, unsigned int num)
+{
+	g->rng ^= g->rng << 13;
+	g->rng ^= g->rng >> 7;
+	g->rng ^= g->rng << 17;
+
+	return num ? (unsigned int) (g->rng >> 11) % num : 0;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static CFGNode *newNode(Gen *g, NodeType type, char *info)
+{
+	AnalysisCtx *pCtx = g->pCtx;
+	CFGNode *ptr = (CFGNode *) arenaAlloc(&pCtx->arena, sizeof(CFGNode));
+
+	memset(ptr, 0, sizeof(CFGNode));
+	ptr->nType = type;
+	ptr->info = info;
+
+	if (g->pTail)
+		g->pTail->nextCFG = ptr;
+	else
+		pCtx->cfgList = ptr;
+	g->pTail = ptr;
+
+	/* initDFA numbers the nodes in cfgList order */
+	if (pCtx->numCFGNode == g->nodeCap) {
+		g->nodeCap = g->nodeCap ? g->nodeCap << 1 : 1024;
+		g->nodeDepth = (int *) xrealloc(g->nodeDepth, sizeof(int) * g->nodeCap);
+	}
+	g->nodeDepth[pCtx->numCFGNode++] = g->loopDepth;
+
+	if (type == NTLABEL) {
+		if (g->labelNum == g->labelCap) {
+			g->labelCap = g->labelCap ? g->labelCap << 1 : 64;
+			g->labels = (CFGNode **) 
+				xrealloc(g->labels, sizeof(CFGNode *) * g->labelCap);
+		}
+		g->labels[g->labelNum++] = ptr;
+	}
+	if (type == NTBIND)
+		pCtx->numBindNode++;
+	g->budget--;
+
+	return ptr;
+}
+
+/* Add a def or use of a random variable in scope */
+static void addOp(Gen *g, CFGNode *ptr, bool isDef)
+{
+	AnalysisCtx *pCtx = g->pCtx;
+	Operand *pOp;
+	int id;
+
+	if (!g->visNum)
+		return;
+
+	id = g->visible[rnd(g, g->visNum)];
+	pOp = (Operand *) arenaAlloc(&pCtx->arena, sizeof(Operand));
+	pOp->id = id;
+	pOp->name = pCtx->varList[id]->name;
+
+	if (isDef) {
+		pOp->next = ptr->defOp;
+		ptr->defOp = pOp;
+	} else {
+		pOp->next = ptr->useOp;
+		ptr->useOp = pOp;
+	}
+}
+
+static CFGNode *genSeq(Gen *g, CFGNode **pLast);
+
+/* 
+ * Open a bind declaring new variables, which stay in scope until
+ * closeBind().
+ */
+static CFGNode *openBind(Gen *g)
+{
+	AnalysisCtx *pCtx = g->pCtx;
+	CFGNode *pParent = g->pBind;
+	CFGNode *pBind;
+	tree pPrev = NULL;
+	int i;
+
+	pBind = newNode(g, NTBIND, "BIND");
+	pBind->parentBind = pParent;
+	pBind->scopeId = pCtx->scopeNum++;
+	pBind->childIdx = pParent ? pParent->childNum++ : 0;
+
+	for (i=0; i<g->pParams->varNum; i++) {
+		tree decl = (tree) arenaAlloc(&pCtx->arena, sizeof(struct tree_node));
+		tree ident = (tree) arenaAlloc(&pCtx->arena, sizeof(struct tree_node));
+
+		memset(decl, 0, sizeof(struct tree_node));
+		memset(ident, 0, sizeof(struct tree_node));
+		ident->code = IDENTIFIER_NODE;
+		ident->ident = (char *) names[rnd(g, NAME_NUM)];
+		decl->code = VAR_DECL;
+		decl->name = ident;
+
+		if (pPrev)
+			pPrev->chain = decl;
+		else
+			pBind->decls = decl;
+		pPrev = decl;
+
+		if (g->visNum == g->visCap) {
+			g->visCap = g->visCap ? g->visCap << 1 : 64;
+			g->visible = (int *) xrealloc(g->visible, sizeof(int) * g->visCap);
+		}
+		g->visible[g->visNum++] = internVar(pCtx, (char *) ident->ident, 
+			pBind, decl, i)->id;
+	}
+
+	g->pBind = pBind;
+	g->bindDepth++;
+
+	return pBind;
+}
+
+/* Leave pBind, its variables went in after the first saveVis */
+static void closeBind(Gen *g, CFGNode *pBind, int saveVis)
+{
+	g->bindDepth--;
+	g->pBind = pBind->parentBind;
+	g->visNum = saveVis;
+}
+
+/* 
+ * Bind with a body of statements. The body of the function bind
+ * takes the whole remaining budget.
+ */
+static CFGNode *genBind(Gen *g, CFGNode **pLast, bool isBody)
+{
+	int saveVis = g->visNum;
+	CFGNode *pFirst = openBind(g);
+	CFGNode *pEnd;
+
+	pFirst->next = genSeq(g, pLast);
+	while (isBody && g->budget > 0) {
+		pEnd = *pLast;
+		pEnd->next = genSeq(g, pLast);
+	}
+
+	closeBind(g, pFirst, saveVis);
+
+	return pFirst;
+}
+
+/* One statement, first node returned and last in *pLast */
+static CFGNode *genStmt(Gen *g, CFGNode **pLast)
+{
+	BenchParams *pParams = g->pParams;
+	AnalysisCtx *pCtx = g->pCtx;
+	unsigned int kind = g->budget < 16 || g->depth >= MAX_NEST ? 
+		0 : rnd(g, 20);
+	CFGNode *pFirst, *ptr, *pEnd;
+	int i;
+
+	g->depth++;
+
+	if (kind >= 11 && kind < 14 && g->loopDepth < pParams->loopDepth) {
+		/* Loop: label, condition, body, goto back, exit label */
+		CFGNode *pCond;
+
+		g->loopDepth++;
+		pFirst = newNode(g, NTLABEL, "LOOP");
+		pCond = newNode(g, NTIF, "COND");
+		addOp(g, pCond, false);
+		pFirst->next = pCond;
+
+		pCond->bTrue = genSeq(g, &pEnd);
+
+		pEnd->next = newNode(g, NTGOTO, "GOTO");
+		pEnd->next->next = pFirst;
+		g->loopDepth--;
+		*pLast = pCond->bFalse = newNode(g, NTLABEL, "LOOP_EXIT");
+
+	} else if (kind >= 14 && kind < 17 && pParams->fanOut > 0) {
+		/* 
+		 * Switch: cases fall through or jump to the exit. When the
+		 * body declares variables the cases hang off its bind, as
+		 * walkStmt builds them.
+		 */
+		int caseNum = 1 + rnd(g, pParams->fanOut);
+		bool hasDefault = rnd(g, 2);
+		bool hasBind = g->bindDepth < pParams->bindDepth && rnd(g, 2);
+		CFGNode **caseEnds = (CFGNode **) 
+			xmalloc(sizeof(CFGNode *) * caseNum);
+		int saveVis = g->visNum;
+		CFGNode *pTable;
+
+		pFirst = pTable = newNode(g, NTSWITCH, "SWITCH");
+		addOp(g, pFirst, false);
+		if (hasBind)
+			pFirst->next = pTable = openBind(g);
+
+		pTable->caseNum = caseNum + !hasDefault;
+		pTable->caseTable = (CFGNode **) 
+			arenaAlloc(&pCtx->arena, sizeof(CFGNode *) * pTable->caseNum);
+
+		for (i=0; i<caseNum; i++) {
+			pTable->caseTable[i] = newNode(g, NTLABEL, "CASE");
+			pTable->caseTable[i]->next = genSeq(g, &caseEnds[i]);
+		}
+
+		if (hasBind)
+			closeBind(g, pTable, saveVis);
+
+		*pLast = newNode(g, NTLABEL, "SWITCH_EXIT");
+		if (!hasDefault)
+			pTable->caseTable[caseNum] = *pLast;
+
+		for (i=0; i<caseNum; i++) {
+			if (i + 1 < caseNum && rnd(g, 3) == 0) {
+				caseEnds[i]->next = pTable->caseTable[i + 1];
+			} else {
+				caseEnds[i]->next = newNode(g, NTGOTO, "BREAK");
+				caseEnds[i]->next->next = *pLast;
+			}
+		}
+
+		free(caseEnds);
+
+	} else if (kind >= 17 && g->bindDepth < pParams->bindDepth) {
+		pFirst = genBind(g, pLast, false);
+
+	} else if (kind >= 8 && kind < 11) {
+		/* If with an optional else, joined by a marker */
+		pFirst = newNode(g, NTIF, "IF");
+		addOp(g, pFirst, false);
+
+		pFirst->bTrue = genSeq(g, &pEnd);
+		*pLast = newNode(g, NTNORMAL, "IF_END");
+		pEnd->next = *pLast;
+
+		if (rnd(g, 2)) {
+			pFirst->bFalse = genSeq(g, &pEnd);
+			pEnd->next = *pLast;
+		} else {
+			pFirst->bFalse = *pLast;
+		}
+
+	} else if (pParams->jumpRate && g->labelNum && 
+		(int) rnd(g, 100) < pParams->jumpRate) 
+	{
+		/* Branch back to any earlier label, maybe into another loop */
+		pFirst = newNode(g, NTIF, "JUMP");
+		addOp(g, pFirst, false);
+		pFirst->bTrue = g->labels[rnd(g, g->labelNum)];
+		*pLast = pFirst->bFalse = newNode(g, NTNORMAL, "JUMP_END");
+
+	} else {
+		pFirst = *pLast = ptr = newNode(g, NTNORMAL, "STMT");
+		if (rnd(g, 5) < 3)
+			addOp(g, ptr, true);
+		for (i=rnd(g, 3); i>0; i--)
+			addOp(g, ptr, false);
+	}
+
+	g->depth--;
+
+	return pFirst;
+}
+
+/* A few statements in a row, more at the top level */
+static CFGNode *genSeq(Gen *g, CFGNode **pLast)
+{
+	int num = 1 + rnd(g, 6);
+	CFGNode *pFirst, *pEnd;
+
+	pFirst = genStmt(g, &pEnd);
+
+	while (--num > 0 && g->budget > 0) {
+		pEnd->next = genStmt(g, pLast);
+		pEnd = *pLast;
+	}
+
+	*pLast = pEnd;
+
+	return pFirst;
+}
+
+/* Generate one function into the context, return its entry */
+static CFGNode *genFunc(Gen *g)
+{
+	CFGNode *pEnd;
+
+	g->budget = g->pParams->nodeNum;
+	g->pTail = NULL;
+	g->pBind = NULL;
+	g->visNum = 0;
+	g->labelNum = 0;
+	g->loopDepth = g->bindDepth = g->depth = 0;
+
+	/* The body is a bind, like a function body in GENERIC */
+	return genBind(g, &pEnd, true);
+}
+
+/* Nearest common dominator of two nodes, by reverse postorder number */
+static int domMeet(int *idom, int a, int b)
+{
+	while (a != b) {
+		while (a > b)
+			a = idom[a];
+		while (b > a)
+			b = idom[b];
+	}
+
+	return a;
+}
+
+/* 
+ * Check what buildLoops() left on the nodes. Dominators are computed
+ * again with the iterative algorithm of Cooper, Harvey and Kennedy
+ * over the reverse postorder, and loop depths are compared with the
+ * nesting the generator recorded, unless -j added jumps that do not
+ * follow it. Returns the number of mismatches.
+ */
+static int checkLoops(Gen *g, CFGNode *pEntry)
+{
+	AnalysisCtx *pCtx = g->pCtx;
+	int numNode = pCtx->numNode;
+	CFGNode **order = (CFGNode **) xmalloc(sizeof(CFGNode *) * (numNode + 1));
+	CFGNode **stack = (CFGNode **) xmalloc(sizeof(CFGNode *) * (numNode + 1));
+	int *rpo = (int *) xmalloc(sizeof(int) * (numNode + 1));
+	int *nextSuc = (int *) xcalloc(numNode + 1, sizeof(int));
+	int *idom = (int *) xmalloc(sizeof(int) * (numNode + 1));
+	int top = 0, num = numNode, reached, badNum = 0;
+	bool changed = true;
+	int i, j;
+
+	memset(rpo, -1, sizeof(int) * numNode);
+
+	/* Postorder into the top of order, the reachable part ends up first */
+	rpo[pEntry->id] = 0;
+	stack[top++] = pEntry;
+	while (top) {
+		CFGNode *ptr = stack[top - 1];
+
+		if (nextSuc[ptr->id] < ptr->succNum) {
+			CFGNode *pSuc = ptr->succs[nextSuc[ptr->id]++];
+
+			if (rpo[pSuc->id] < 0) {
+				rpo[pSuc->id] = 0;
+				stack[top++] = pSuc;
+			}
+		} else {
+			order[--num] = ptr;
+			top--;
+		}
+	}
+
+	reached = numNode - num;
+	for (i=0; i<reached; i++) {
+		order[i] = order[num + i];
+		rpo[order[i]->id] = i;
+		idom[i] = -1;
+	}
+	idom[0] = 0;
+
+	while (changed) {
+		changed = false;
+
+		for (i=1; i<reached; i++) {
+			CFGNode *ptr = order[i];
+			int newIdom = -1;
+
+			for (j=0; j<ptr->predNum; j++) {
+				int p = rpo[ptr->preds[j]->id];
+
+				if (p < 0 || idom[p] < 0)
+					continue;
+				newIdom = newIdom < 0 ? p : domMeet(idom, newIdom, p);
+			}
+
+			if (idom[i] != newIdom) {
+				idom[i] = newIdom;
+				changed = true;
+			}
+		}
+	}
+
+	for (i=0; i<numNode; i++) {
+		CFGNode *ptr = pCtx->nodeTable[i];
+		int r = rpo[i];
+		CFGNode *pIdom = r > 0 ? order[idom[r]] : NULL;
+
+		if (ptr->idom != pIdom)
+			badNum++;
+		else if (!g->pParams->jumpRate && 
+			ptr->loopDepth != (r < 0 ? 0 : g->nodeDepth[i]))
+			badNum++;
+	}
+
+	free(order);
+	free(stack);
+	free(rpo);
+	free(nextSuc);
+	free(idom);
+
+	return badNum;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-f funcs] [-n nodes] [-l loop depth] "
+		"[-s fan-out] [-b bind depth] [-v vars per bind] [-r rounds] "
+		"[-x seed] [-e dense|sparse|auto] [-j rate] [-p] [-c]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	BenchParams params = { 20, 2000, 3, 4, 4, 8, 5, 1, 0, false, false };
+	FILE *devNull = fopen("/dev/null", "w");
+	AnalysisCtx *pCtx;
+	struct rusage rusage;
+	Gen gen;
+	double solveTime = 0;
+	long nodeNum = 0, varNum = 0, bindNum = 0, visitNum = 0;
+	long allocNum = 0, allocBytes = 0, peakHeap = 0;
+	long loopNum = 0, badNum = 0;
+	double loopTime = 0;
+	int loopMax = 0;
+	int iterMax = 0, iterSum = 0;
+	int opt, f, r;
+
+	traceInit();
+	dfaEngineInit();
+	dfaOutputInit();
+
+	while ((opt = getopt(argc, argv, "f:n:l:s:b:v:r:x:e:j:pc")) != -1) {
+		switch (opt) {
+			case 'f': params.funcNum = atoi(optarg); break;
+			case 'n': params.nodeNum = atoi(optarg); break;
+			case 'l': params.loopDepth = atoi(optarg); break;
+			case 's': params.fanOut = atoi(optarg); break;
+			case 'b': params.bindDepth = atoi(optarg); break;
+			case 'v': params.varNum = atoi(optarg); break;
+			case 'r': params.rounds = atoi(optarg); break;
+			case 'x': params.seed = strtoul(optarg, NULL, 0); break;
+			case 'p': params.print = true; break;
+			case 'j': params.jumpRate = atoi(optarg); break;
+			case 'c': params.check = true; break;
+			case 'e':
+				if (strcmp(optarg, "dense") == 0)
+					gDfaEngine = DFA_DENSE;
+				else if (strcmp(optarg, "sparse") == 0)
+					gDfaEngine = DFA_SPARSE;
+				else if (strcmp(optarg, "auto") == 0)
+					gDfaEngine = DFA_AUTO;
+				else
+					usage(argv[0]);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+
+	if (params.funcNum <= 0 || params.nodeNum < 16 || params.rounds <= 0 ||
+		params.varNum <= 0 || params.loopDepth < 0 || params.fanOut < 0 ||
+		params.bindDepth < 0 || params.jumpRate < 0 || params.jumpRate > 100)
+		usage(argv[0]);
+
+	pCtx = (AnalysisCtx *) xcalloc(1, sizeof(AnalysisCtx));
+	pCtx->traceFile = gTraceFile;
+	pCtx->varTable = hashCreateTable(256);
+	pCtx->perf.missFd = pCtx->perf.refFd = -1;
+	if (TRACE_ON(TRACE_CFG))
+		perfOpen(&pCtx->perf);
+
+	memset(&gen, 0, sizeof(Gen));
+	gen.pParams = &params;
+	gen.pCtx = pCtx;
+	/* xorshift must not start at 0 */
+	gen.rng = params.seed * 0x9E3779B97F4A7C15UL + 88172645463325252UL;
+
+	for (f=0; f<params.funcNum; f++) {
+		CFGNode *pEntry;
+		char funcName[32];
+
+		pCtx->cfgList = NULL;
+		pCtx->numCFGNode = pCtx->numBindNode = pCtx->scopeNum = 0;
+		pCtx->varNum = 0;
+		hashClearTable(pCtx->varTable);
+		arenaReset(&pCtx->arena);
+
+		sprintf(funcName, "f%d", f);
+		pEntry = genFunc(&gen);
+
+		nodeNum += pCtx->numCFGNode;
+		varNum += pCtx->varNum;
+		bindNum += pCtx->numBindNode;
+
+		for (r=0; r<params.rounds; r++) {
+			long baseHeap;
+			double t0;
+
+			allocReset();
+			baseHeap = allocHeap();
+			t0 = now();
+
+			doDFA(pCtx, params.print && r == 0 ? stdout : devNull, pEntry, 
+				funcName);
+
+			solveTime += now() - t0;
+			allocNum += gAllocStats.allocNum;
+			allocBytes += gAllocStats.allocBytes;
+			/* The solver keeps what it allocated until freeDFA() */
+			if (allocHeap() - baseHeap > peakHeap)
+				peakHeap = allocHeap() - baseHeap;
+			visitNum += pCtx->dfaVisitNum;
+
+			if (params.check && r == 0) {
+				t0 = now();
+				buildLoops(pCtx, pEntry);
+				loopTime += now() - t0;
+
+				loopNum += pCtx->loopNum;
+				if (pCtx->loopMaxDepth > loopMax)
+					loopMax = pCtx->loopMaxDepth;
+				badNum += checkLoops(&gen, pEntry);
+			}
+
+			freeDFA(pCtx);
+		}
+
+		iterSum += pCtx->dfaIterNum;
+		if (pCtx->dfaIterNum > iterMax)
+			iterMax = pCtx->dfaIterNum;
+	}
+
+	getrusage(RUSAGE_SELF, &rusage);
+
+	fprintf(stderr, 
+		"dfabench: %d functions, %ld nodes, %ld variables, %ld binds\n"
+		"doDFA: %.3f ms per round, %.1f us per function\n"
+		"solver: %.1f iterations on average, %d at most, %ld visits "
+		"per round\n"
+		"allocations: %.1f per function, %.1f KB per function, "
+		"peak %.1f KB held\n"
+		"maxrss: %ld KB\n",
+		params.funcNum, nodeNum, varNum, bindNum,
+		solveTime * 1e3 / params.rounds,
+		solveTime * 1e6 / params.rounds / params.funcNum,
+		(double) iterSum / params.funcNum, iterMax, 
+		visitNum / params.rounds,
+		(double) allocNum / params.rounds / params.funcNum,
+		allocBytes / 1024.0 / params.rounds / params.funcNum,
+		peakHeap / 1024.0, rusage.ru_maxrss);
+
+	if (params.check) {
+		fprintf(stderr, "loops: %ld natural loops, nested %d deep, "
+			"buildLoops %.1f us per function, %ld nodes wrong\n", 
+			loopNum, loopMax, loopTime * 1e6 / params.funcNum, badNum);
+	}
+
+	freeDFAScratch(pCtx);
+	perfClose(&pCtx->perf);
+	hashDeleteTable(pCtx->varTable, NULL);
+	arenaFree(&pCtx->arena);
+	free(pCtx->varList);
+	free(pCtx);
+	free(gen.visible);
+	free(gen.nodeDepth);
+	free(gen.labels);
+	fclose(devNull);
+	traceFin();
+
+	return badNum ? 1 : 0;
+}
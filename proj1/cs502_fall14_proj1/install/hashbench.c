@@ -0,0 +1,172 @@
+/*
+ * Microbenchmark for hashtable.c. Interns keys shaped like the ones
+ * csproj2.c uses for variables, a scope id and decl index for locals
+ * and the name for globals and parameters, hashed the same way, and
+ * times inserts, hits, misses and removes, with the probe lengths of
+ * the full table.
+ *
+ * Build with "make hashbench", run as
+ *     ./hashbench [keys] [rounds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hashtable.h"
+
+/* One in this many keys is a global or parameter, keyed by name */
+#define NAMED_RATIO	8
+
+typedef struct BenchKey {
+	/* Set for keys by name only */
+	char *name;
+	int scopeId;
+	int declIdx;
+	unsigned int hashVal;
+} BenchKey;
+
+/* Same test as cmpEqual() in csproj2.c */
+static bool benchCmp(void *a, void *b)
+{
+	BenchKey *pA = (BenchKey *)a;
+	BenchKey *pB = (BenchKey *)b;
+
+	if (!pA->name || !pB->name)
+		return !pA->name && !pB->name && pA->scopeId == pB->scopeId && 
+			pA->declIdx == pB->declIdx;
+
+	return strcmp(pA->name, pB->name) == 0;
+}
+
+/* 
+ * Distinct keys: locals of scopes first .. first + num / 4 with up to
+ * eight decls each, and a few globals named after base. Different
+ * calls keep their key sets apart by first and base.
+ */
+static void makeKeys(BenchKey *pKeys, int num, int first, const char *base,
+	unsigned int seed)
+{
+	static const char *idents[] = {
+		"i", "j", "n", "len", "tmp", "count", "result", "buffer",
+	};
+	int scopeNum = num / 4 + 1;
+	char *used = (char *) xcalloc((size_t) scopeNum * 8, 1);
+	char buf[128];
+	int i;
+
+	srand(seed);
+
+	for (i=0; i<num; i++) {
+		BenchKey *pKey = &pKeys[i];
+		int slot;
+
+		if (rand() % NAMED_RATIO == 0) {
+			int len = sprintf(buf, "%s%s_%d", base, idents[rand() % 8], i);
+
+			pKey->name = strdup(buf);
+			pKey->scopeId = pKey->declIdx = -1;
+			pKey->hashVal = hashing(buf, len);
+			continue;
+		}
+
+		/* Less than half of the slots are taken, so this ends quickly */
+		do {
+			slot = rand() % (scopeNum * 8);
+		} while (used[slot]);
+		used[slot] = 1;
+
+		pKey->name = NULL;
+		pKey->scopeId = first + slot / 8;
+		pKey->declIdx = slot % 8;
+		pKey->hashVal = hashPair(pKey->scopeId, pKey->declIdx);
+	}
+
+	free(used);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void runBench(const char *title, BenchKey *pKeys, BenchKey *pMiss,
+	int num, int rounds)
+{
+	double tInsert = 0, tHit = 0, tMiss = 0, tRemove = 0;
+	long found = 0;
+	int r, i;
+
+	for (r=0; r<rounds; r++) {
+		HashTable *pTab = hashCreateTable(256);
+		double t0, t1, t2, t3, t4, t5;
+
+		t0 = now();
+		for (i=0; i<num; i++)
+			hashLookupTable(pTab, pKeys[i].hashVal, benchCmp, &pKeys[i], true);
+		t1 = now();
+		for (i=0; i<num; i++)
+			found += hashLookupTable(pTab, pKeys[i].hashVal, benchCmp,
+				&pKeys[i], false) != NULL;
+		t2 = now();
+		for (i=0; i<num; i++)
+			found += hashLookupTable(pTab, pMiss[i].hashVal, benchCmp,
+				&pMiss[i], false) != NULL;
+		t3 = now();
+
+		if (r == rounds - 1)
+			hashDumpStats(pTab, stdout, title);
+
+		t4 = now();
+		for (i=0; i<num; i++)
+			found -= hashRemoveTable(pTab, pKeys[i].hashVal, benchCmp,
+				&pKeys[i]) == NULL;
+		t5 = now();
+
+		tInsert += t1 - t0;
+		tHit += t2 - t1;
+		tMiss += t3 - t2;
+		tRemove += t5 - t4;
+
+		if (pTab->entryCnt) {
+			fprintf(stderr, "%s: entries left after remove\n", title);
+			exit(1);
+		}
+		hashDeleteTable(pTab, NULL);
+	}
+
+	if (found != (long) num * rounds) {
+		fprintf(stderr, "%s: wrong lookup results\n", title);
+		exit(1);
+	}
+
+	printf("%s: insert %.1f ns, hit %.1f ns, miss %.1f ns, remove %.1f ns\n",
+		title, tInsert * 1e9 / ((double) num * rounds),
+		tHit * 1e9 / ((double) num * rounds),
+		tMiss * 1e9 / ((double) num * rounds),
+		tRemove * 1e9 / ((double) num * rounds));
+}
+
+int main(int argc, char **argv)
+{
+	int num = argc > 1 ? atoi(argv[1]) : 100000;
+	int rounds = argc > 2 ? atoi(argv[2]) : 10;
+	BenchKey *pKeys, *pMiss;
+
+	if (num <= 0 || rounds <= 0) {
+		fprintf(stderr, "usage: %s [keys] [rounds]\n", argv[0]);
+		return 1;
+	}
+
+	pKeys = (BenchKey *) xmalloc(sizeof(BenchKey) * num);
+	pMiss = (BenchKey *) xmalloc(sizeof(BenchKey) * num);
+	makeKeys(pKeys, num, 0, "", 1);
+	makeKeys(pMiss, num, num / 4 + 1, "m_", 2);
+
+	runBench("hashtable", pKeys, pMiss, num, rounds);
+
+	return 0;
+}
@@ -2,11 +2,59 @@
 #include <assert.h>
 #include "hashtable.h"
 
+/* 
+ * Removed entries of a linear table leave a tombstone behind, so
+ * lookups keep probing past them. Inserts reuse tombstones and a
+ * resize drops them.
+ */
+static char hashTomb;
+#define HASH_TOMB ((void *) &hashTomb)
+#define HASH_LIVE(pData) ((pData) && (pData) != HASH_TOMB)
+
+/*
+ * String hash over len bytes. The name is consumed a word at a time
+ * and the result is run through a final mixer, because scoped names
+ * share long prefixes and the tables index by the low bits.
+ */
+unsigned int hashing(const char *name, size_t len)
+{
+    const unsigned long mul = 0x9E3779B97F4A7C15UL;
+    unsigned long hashVal = len * mul;
+    unsigned long word;
+
+    for (; len >= sizeof(word); name += sizeof(word), len -= sizeof(word)) {
+        memcpy(&word, name, sizeof(word));
+        hashVal = ((hashVal << 5 | hashVal >> 59) ^ word) * mul;
+    }
+
+    if (len) {
+        word = 0;
+        memcpy(&word, name, len);
+        hashVal = ((hashVal << 5 | hashVal >> 59) ^ word) * mul;
+    }
+
+    hashVal ^= hashVal >> 33;
+    hashVal *= 0xFF51AFD7ED558CCDUL;
+    hashVal ^= hashVal >> 33;
+
+    return (unsigned int) hashVal;
+}
+
+/* Hash of a pair of integers, e.g. a scope id and a decl index */
+unsigned int hashPair(unsigned int hi, unsigned int lo)
+{
+    unsigned long val = (unsigned long) hi << 32 | lo;
+
+    val *= 0x9E3779B97F4A7C15UL;
+
+    return (unsigned int) (val >> 32);
+}
+
 /*
  * For any number, we can round it up to a number as
  * power of 2
  */
-static hUpPow2(unsigned int val)
+static unsigned int hUpPow2(unsigned int val)
 {
     val--;
     val |= val >> 1;
@@ -34,7 +82,7 @@ static bool hashResizeTable(HashTable *pTab, unsigned int newSize)
 
         void *pData = pTab->mainEntry[i].pData;
 
-        if (pData) {
+        if (HASH_LIVE(pData)) {
             unsigned int hashVal = pTab->mainEntry[i].hashVal;
             unsigned int newIdx =  hashVal & (newSize - 1);
 
@@ -50,21 +98,20 @@ static bool hashResizeTable(HashTable *pTab, unsigned int newSize)
 
     pTab->mainEntry = pNewEntry;
     pTab->tableSize = newSize;
+    pTab->tombCnt = 0;
 
     return true;
 }
 
 void hashDeleteTable(HashTable *pTab, DelFunc doDel)
 {
-    int i;
-
-    for (i=0; i<pTab->tableSize; i++) {
+    HashIter iter;
+    void *pData;
 
-        void *pData = pTab->mainEntry[i].pData;
+    hashIterInit(&iter, pTab);
 
-        if (pData)
-			doDel(pData);
-    }
+    while (doDel && (pData = hashIterNext(&iter)))
+        doDel(pData);
 
     free(pTab->mainEntry);
     free(pTab);
@@ -85,25 +132,53 @@ HashTable *hashCreateTable(unsigned int tableSize)
 
     pTab->mainEntry = (HashEntry *) xcalloc(allocSize, sizeof(HashEntry));
 
-    pTab->tableSize = allocSize;
+    pTab->tableSize = pTab->initSize = allocSize;
 
     pTab->entryCnt = 0;
 
+    pTab->tombCnt = 0;
+
     return pTab;
 }
 
+/* 
+ * Rehash once the load factor is reached, 75% by default. Tombstones
+ * count as load. When most of the load is tombstones the table is
+ * rebuilt at the same size instead of doubled.
+ */
+static void hashCheckLoad(HashTable *pTab)
+{
+    if ((pTab->entryCnt + pTab->tombCnt) * 4 > pTab->tableSize * 3) {
+        unsigned int newSize = pTab->tableSize;
+        bool resized;
+
+        if (pTab->entryCnt * 8 > pTab->tableSize * 3)
+            newSize <<= 1;
+
+        resized = hashResizeTable(pTab, newSize);
+
+        /* Resizing must work */
+        assert(resized);
+        (void) resized;
+    }
+}
+
 /* Hashtable lookup function implementation */
 void *hashLookupTable(HashTable *pTab, unsigned int hashVal, CmpFunc isEqual,
     void *pData, bool doAdd)
 {
     HashEntry *pEntry = &pTab->mainEntry[hashVal & (pTab->tableSize - 1)];
     HashEntry *pEnd = &pTab->mainEntry[pTab->tableSize];
+    HashEntry *pTomb = NULL;
     void *result = NULL;
 
-    while (pEntry->pData && 
-        (pEntry->hashVal != hashVal || !(*isEqual)(pEntry->pData, pData)))
+    while (pEntry->pData && (pEntry->pData == HASH_TOMB ||
+        pEntry->hashVal != hashVal || !(*isEqual)(pEntry->pData, pData)))
     {
 
+        if (pEntry->pData == HASH_TOMB && !pTomb)
+            pTomb = pEntry;
+
         pEntry++;
         
         if (pEntry == pEnd)
@@ -114,18 +189,18 @@ void *hashLookupTable(HashTable *pTab, unsigned int hashVal, CmpFunc isEqual,
     /* Didn't find a match */
     if (!pEntry->pData) {
         if (doAdd) {
+            /* Reuse the first tombstone on the way */
+            if (pTomb) {
+                pEntry = pTomb;
+                pTab->tombCnt--;
+            }
+
             pEntry->pData = pData;
             pEntry->hashVal = hashVal;
             pTab->entryCnt++;
 
-            /* 
-             * Resize the hashtable if load factor achieved.
-             * Load factor is 75% by default
-             */
-            if (pTab->entryCnt * 4 > pTab->tableSize * 3) {
-                /* Resizing myst work */
-                assert(hashResizeTable(pTab, pTab->tableSize << 1));
-            }
+            /* Resize the hashtable if load factor achieved */
+            hashCheckLoad(pTab);
             
             result = pData;
         } else {
@@ -139,3 +214,144 @@ void *hashLookupTable(HashTable *pTab, unsigned int hashVal, CmpFunc isEqual,
 
     return result;
 }
+
+/* 
+ * Remove the entry equal to pData and return it, or NULL if there
+ * is none. The entry leaves a tombstone unless the run ends right
+ * after it.
+ */
+void *hashRemoveTable(HashTable *pTab, unsigned int hashVal, 
+    CmpFunc isEqual, void *pData)
+{
+    HashEntry *pEntries = pTab->mainEntry;
+    unsigned int mask = pTab->tableSize - 1;
+    unsigned int idx = hashVal & mask;
+    void *result;
+
+    while (pEntries[idx].pData) {
+
+        HashEntry *pEntry = &pEntries[idx];
+
+        if (pEntry->pData != HASH_TOMB && pEntry->hashVal == hashVal && 
+            (*isEqual)(pEntry->pData, pData))
+            break;
+
+        idx = (idx + 1) & mask;
+    }
+
+    result = pEntries[idx].pData;
+
+    if (!result)
+        return NULL;
+
+    pTab->entryCnt--;
+
+    if (!pEntries[(idx + 1) & mask].pData) {
+        pEntries[idx].pData = NULL;
+    } else {
+        pEntries[idx].pData = HASH_TOMB;
+        pTab->tombCnt++;
+    }
+
+    return result;
+}
+
+/* 
+ * Remove every entry but keep the slots for the next use. A table of
+ * which less than 1/16 is in use is given back instead, for one twice
+ * the size of what is in use, so a table grown once by a large user
+ * does not make every later clear cost its full size.
+ */
+void hashClearTable(HashTable *pTab)
+{
+    int used = pTab->entryCnt + pTab->tombCnt;
+    HashEntry *pNewEntry = NULL;
+
+    if (pTab->tableSize > pTab->initSize && used * 16 < pTab->tableSize) {
+        unsigned int newSize = used ? hUpPow2(used * 2) : 0;
+
+        if (newSize < (unsigned int) pTab->initSize)
+            newSize = pTab->initSize;
+
+        pNewEntry = (HashEntry *) xcalloc(newSize, sizeof(HashEntry));
+        if (pNewEntry) {
+            free(pTab->mainEntry);
+            pTab->mainEntry = pNewEntry;
+            pTab->tableSize = newSize;
+        }
+    }
+
+    if (!pNewEntry)
+        memset(pTab->mainEntry, 0, sizeof(HashEntry) * pTab->tableSize);
+    pTab->entryCnt = 0;
+    pTab->tombCnt = 0;
+}
+
+void hashIterInit(HashIter *pIter, HashTable *pTab)
+{
+    pIter->pTab = pTab;
+    pIter->idx = 0;
+}
+
+/* 
+ * Return the next entry of the table, or NULL when all are visited.
+ * The table must not be changed while it is iterated.
+ */
+void *hashIterNext(HashIter *pIter)
+{
+    HashTable *pTab = pIter->pTab;
+
+    while (pIter->idx < pTab->tableSize) {
+
+        void *pData = pTab->mainEntry[pIter->idx++].pData;
+
+        if (HASH_LIVE(pData))
+            return pData;
+    }
+
+    return NULL;
+}
+
+/* Probe lengths from 0 to HASH_HIST_MAX - 1, longer ones share the last */
+#define HASH_HIST_MAX 16
+
+/*
+ * Print the probe-length histogram of a table. The probe length of an
+ * entry is its distance from the slot its hash value maps to, which
+ * is what a lookup of that entry has to step over.
+ */
+void hashDumpStats(HashTable *pTab, FILE *file, const char *title)
+{
+    unsigned int mask = pTab->tableSize - 1;
+    int hist[HASH_HIST_MAX];
+    int i, maxProbe = 0;
+    long totalProbe = 0;
+
+    memset(hist, 0, sizeof(hist));
+
+    for (i=0; i<pTab->tableSize; i++) {
+
+        HashEntry *pEntry = &pTab->mainEntry[i];
+
+        if (HASH_LIVE(pEntry->pData)) {
+            int probe = (i - (pEntry->hashVal & mask)) & mask;
+
+            totalProbe += probe;
+            if (probe > maxProbe)
+                maxProbe = probe;
+            hist[probe < HASH_HIST_MAX ? probe : HASH_HIST_MAX - 1]++;
+        }
+    }
+
+    fprintf(file, "%s: %d entries, %d tombstones, %d slots, "
+        "avg probe %.2f, max probe %d\n",
+        title, pTab->entryCnt, pTab->tombCnt, pTab->tableSize,
+        pTab->entryCnt ? (double) totalProbe / pTab->entryCnt : 0.0,
+        maxProbe);
+
+    for (i=0; i<HASH_HIST_MAX; i++) {
+        if (hist[i])
+            fprintf(file, "  probe %s%2d: %d\n", 
+                i == HASH_HIST_MAX - 1 ? ">=" : "  ", i, hist[i]);
+    }
+}
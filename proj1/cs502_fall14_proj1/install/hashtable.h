@@ -1,6 +1,15 @@
 #ifndef _HASH_TAB_
 #define _HASH_TAB_
 
+#ifdef CS502_STANDALONE
+/* Built outside of gcc, e.g. by hashbench */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#define xmalloc malloc
+#define xcalloc calloc
+#else
 #include "config.h"
 #include "system.h"
 #include "coretypes.h"
@@ -12,6 +21,7 @@
 #include "tree-iterator.h"
 #include "pretty-print.h"
 #include "hashtable.h"
+#endif
 
 /* Open addressing implementation */
 typedef struct HashEntry {
@@ -21,16 +31,33 @@ typedef struct HashEntry {
 
 typedef struct HashTable {
     int tableSize;
+    /* Size asked for at creation, a table does not shrink below it */
+    int initSize;
     int entryCnt;
+    int tombCnt;
     HashEntry *mainEntry;
 } HashTable;
 
+/* Cursor over the entries of a table, see hashIterNext() */
+typedef struct HashIter {
+    HashTable *pTab;
+    int idx;
+} HashIter;
+
 typedef bool (*CmpFunc)(void *, void *);
 typedef void (*DelFunc)();
 
+unsigned int hashing(const char *name, size_t len);
+unsigned int hashPair(unsigned int hi, unsigned int lo);
 HashTable *hashCreateTable(unsigned int tableSize);
 void hashDeleteTable(HashTable *pTab, DelFunc doDel);
 void *hashLookupTable(HashTable *pTab, unsigned int hashVal, CmpFunc isEqual,
     void *pData, bool doAdd);
+void *hashRemoveTable(HashTable *pTab, unsigned int hashVal, 
+    CmpFunc isEqual, void *pData);
+void hashClearTable(HashTable *pTab);
+void hashIterInit(HashIter *pIter, HashTable *pTab);
+void *hashIterNext(HashIter *pIter);
+void hashDumpStats(HashTable *pTab, FILE *file, const char *title);
 
 #endif
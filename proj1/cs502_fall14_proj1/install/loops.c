@@ -0,0 +1,330 @@
+/*
+ * Dominators and natural loops of the node graph. buildLoops() runs on
+ * the succs and preds initDFA() built, so it follows next, bTrue,
+ * bFalse, the case tables and every goto to its label. Dominators come
+ * from the simple form of Lengauer and Tarjan's algorithm (path
+ * compression, no balancing). A loop is the body of the back edges
+ * into a node dominating their source, and loops nest by their headers.
+ * Gotos into the middle of a loop make it irreducible; such a cycle has
+ * no header dominating it and is not counted as a loop.
+ */
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "csproj2.h"
+
+/* Scratch of one run, arrays indexed by DFS preorder number */
+typedef struct DomCtx {
+	CFGNode **vertex;
+	int *parent;
+	int *semi;
+	int *idom;
+	int *ancestor;
+	int *label;
+	/* Vertices whose semidominator is v, linked through bucketNext */
+	int *bucket;
+	int *bucketNext;
+	/* Dominator tree preorder number and subtree size */
+	int *domPre;
+	int *domSize;
+	/* Innermost loop holding the vertex, -1 outside of all loops */
+	int *loopOf;
+	int *stack;
+	/* Preorder number of every node id, -1 if not reachable */
+	int *dfsNum;
+	int num;
+} DomCtx;
+
+/* Number the nodes reachable from pEntry in depth first preorder */
+static void domDFS(DomCtx *d, CFGNode *pEntry)
+{
+	int *nextSuc = d->bucketNext;
+	int top = 0;
+
+	d->vertex[0] = pEntry;
+	d->dfsNum[pEntry->id] = 0;
+	d->parent[0] = -1;
+	nextSuc[0] = 0;
+	d->stack[top++] = 0;
+	d->num = 1;
+
+	while (top) {
+		int v = d->stack[top - 1];
+		CFGNode *ptr = d->vertex[v];
+
+		if (nextSuc[v] < ptr->succNum) {
+			CFGNode *pSuc = ptr->succs[nextSuc[v]++];
+
+			if (d->dfsNum[pSuc->id] < 0) {
+				int w = d->num++;
+
+				d->vertex[w] = pSuc;
+				d->dfsNum[pSuc->id] = w;
+				d->parent[w] = v;
+				nextSuc[w] = 0;
+				d->stack[top++] = w;
+			}
+		} else {
+			top--;
+		}
+	}
+}
+
+/*
+ * The vertex with the least semidominator on the forest path up from
+ * v. The path is compressed on the way, top down as the recursive
+ * version would.
+ */
+static int domEval(DomCtx *d, int v)
+{
+	int top = 0;
+	int x;
+
+	if (d->ancestor[v] < 0)
+		return v;
+
+	for (x=v; d->ancestor[d->ancestor[x]] >= 0; x=d->ancestor[x])
+		d->stack[top++] = x;
+
+	while (top) {
+		int a;
+
+		x = d->stack[--top];
+		a = d->ancestor[x];
+		if (d->semi[d->label[a]] < d->semi[d->label[x]])
+			d->label[x] = d->label[a];
+		d->ancestor[x] = d->ancestor[a];
+	}
+
+	return d->label[v];
+}
+
+static void domTree(DomCtx *d)
+{
+	int num = d->num;
+	int v, w, i;
+
+	for (v=0; v<num; v++) {
+		d->semi[v] = d->label[v] = v;
+		d->ancestor[v] = d->bucket[v] = -1;
+		d->idom[v] = 0;
+	}
+
+	for (w=num-1; w>0; w--) {
+		CFGNode *ptr = d->vertex[w];
+		int p = d->parent[w];
+
+		for (i=0; i<ptr->predNum; i++) {
+			int u;
+
+			v = d->dfsNum[ptr->preds[i]->id];
+			if (v < 0)
+				continue;
+
+			u = domEval(d, v);
+			if (d->semi[u] < d->semi[w])
+				d->semi[w] = d->semi[u];
+		}
+
+		d->bucketNext[w] = d->bucket[d->semi[w]];
+		d->bucket[d->semi[w]] = w;
+		d->ancestor[w] = p;
+
+		for (v=d->bucket[p]; v>=0; v=d->bucketNext[v]) {
+			int u = domEval(d, v);
+
+			d->idom[v] = d->semi[u] < d->semi[v] ? u : p;
+		}
+		d->bucket[p] = -1;
+	}
+
+	for (w=1; w<num; w++) {
+		if (d->idom[w] != d->semi[w])
+			d->idom[w] = d->idom[d->idom[w]];
+	}
+
+	/*
+	 * Number the dominator tree in preorder. A dominator comes before
+	 * the vertices it dominates in the DFS as well, so sizes can be
+	 * summed up backward and the numbers handed out forward.
+	 */
+	for (w=0; w<num; w++)
+		d->domSize[w] = 1;
+	for (w=num-1; w>0; w--)
+		d->domSize[d->idom[w]] += d->domSize[w];
+
+	/* bucket holds the next free number under every vertex */
+	d->domPre[0] = 0;
+	d->bucket[0] = 1;
+	for (w=1; w<num; w++) {
+		int p = d->idom[w];
+
+		d->domPre[w] = d->bucket[p];
+		d->bucket[p] += d->domSize[w];
+		d->bucket[w] = d->domPre[w] + 1;
+	}
+}
+
+/* Whether vertex h dominates vertex v */
+static inline bool dominates(DomCtx *d, int h, int v)
+{
+	return d->domPre[h] <= d->domPre[v] &&
+		d->domPre[v] < d->domPre[h] + d->domSize[h];
+}
+
+/* Push the reachable predecessors of vertex v */
+static inline int pushPreds(DomCtx *d, int v, int top)
+{
+	CFGNode *ptr = d->vertex[v];
+	int i;
+
+	for (i=0; i<ptr->predNum; i++) {
+		int u = d->dfsNum[ptr->preds[i]->id];
+
+		if (u >= 0)
+			d->stack[top++] = u;
+	}
+
+	return top;
+}
+
+/*
+ * Find the natural loops, innermost first: headers are taken in
+ * reverse dominator tree preorder, so every loop nested in another
+ * one is done before it. The body is walked backward from the back
+ * edges. A vertex already in a loop stands for the outermost loop
+ * found around it so far, which becomes a child of the new one, and
+ * the walk goes on from that loop's header.
+ */
+static void findLoops(AnalysisCtx *pCtx, DomCtx *d)
+{
+	int num = d->num;
+	int *byPre = d->ancestor;
+	int *header = d->semi;
+	int *loopParent = d->label;
+	int *depth = d->bucketNext;
+	int loopNum = 0, maxDepth = 0;
+	int h, i, l;
+
+	for (h=0; h<num; h++) {
+		byPre[d->domPre[h]] = h;
+		d->loopOf[h] = -1;
+	}
+
+	for (i=num-1; i>=0; i--) {
+		CFGNode *ptr;
+		int loop = -1, top = 0;
+
+		h = byPre[i];
+		ptr = d->vertex[h];
+
+		for (l=0; l<ptr->predNum; l++) {
+			int v = d->dfsNum[ptr->preds[l]->id];
+
+			if (v < 0 || !dominates(d, h, v))
+				continue;
+
+			if (loop < 0) {
+				loop = loopNum++;
+				header[loop] = h;
+				loopParent[loop] = -1;
+				d->loopOf[h] = loop;
+			}
+			if (v != h)
+				d->stack[top++] = v;
+		}
+
+		while (top) {
+			int v = d->stack[--top];
+			int sub = d->loopOf[v];
+
+			if (sub < 0) {
+				d->loopOf[v] = loop;
+				top = pushPreds(d, v, top);
+				continue;
+			}
+
+			while (loopParent[sub] >= 0)
+				sub = loopParent[sub];
+			if (sub == loop)
+				continue;
+
+			loopParent[sub] = loop;
+			top = pushPreds(d, header[sub], top);
+		}
+	}
+
+	/* A loop is found before the ones around it */
+	for (l=loopNum-1; l>=0; l--) {
+		depth[l] = loopParent[l] < 0 ? 1 : depth[loopParent[l]] + 1;
+		if (depth[l] > maxDepth)
+			maxDepth = depth[l];
+	}
+
+	for (h=0; h<num; h++) {
+		CFGNode *ptr = d->vertex[h];
+
+		ptr->idom = h ? d->vertex[d->idom[h]] : NULL;
+		ptr->loopDepth = d->loopOf[h] < 0 ? 0 : depth[d->loopOf[h]];
+	}
+
+	pCtx->loopNum = loopNum;
+	pCtx->loopMaxDepth = maxDepth;
+}
+
+/*
+ * Give every node its immediate dominator and loop depth. Nodes not
+ * reachable from pEntry get neither. Must be called after initDFA().
+ */
+void buildLoops(AnalysisCtx *pCtx, CFGNode *pEntry)
+{
+	int numNode = pCtx->numNode;
+	int numEdge = 0;
+	DomCtx d;
+	CFGNode *ptr;
+
+	for (ptr=pCtx->cfgList; ptr; ptr=ptr->nextCFG) {
+		ptr->idom = NULL;
+		ptr->loopDepth = 0;
+		numEdge += ptr->predNum;
+	}
+
+	pCtx->loopNum = pCtx->loopMaxDepth = 0;
+	if (!pEntry)
+		return;
+
+	d.vertex = (CFGNode **) xmalloc(sizeof(CFGNode *) * (numNode + 1));
+	d.parent = (int *) xmalloc(sizeof(int) * (numNode + 1));
+	d.semi = (int *) xmalloc(sizeof(int) * (numNode + 1));
+	d.idom = (int *) xmalloc(sizeof(int) * (numNode + 1));
+	d.ancestor = (int *) xmalloc(sizeof(int) * (numNode + 1));
+	d.label = (int *) xmalloc(sizeof(int) * (numNode + 1));
+	d.bucket = (int *) xmalloc(sizeof(int) * (numNode + 1));
+	d.bucketNext = (int *) xmalloc(sizeof(int) * (numNode + 1));
+	d.domPre = (int *) xmalloc(sizeof(int) * (numNode + 1));
+	d.domSize = (int *) xmalloc(sizeof(int) * (numNode + 1));
+	d.loopOf = (int *) xmalloc(sizeof(int) * (numNode + 1));
+	/* Every edge is walked backward at most once by findLoops() */
+	d.stack = (int *) xmalloc(sizeof(int) * (numNode + numEdge + 1));
+	d.dfsNum = (int *) xmalloc(sizeof(int) * (numNode + 1));
+	memset(d.dfsNum, -1, sizeof(int) * numNode);
+
+	domDFS(&d, pEntry);
+	domTree(&d);
+	findLoops(pCtx, &d);
+
+	free(d.vertex);
+	free(d.parent);
+	free(d.semi);
+	free(d.idom);
+	free(d.ancestor);
+	free(d.label);
+	free(d.bucket);
+	free(d.bucketNext);
+	free(d.domPre);
+	free(d.domSize);
+	free(d.loopOf);
+	free(d.stack);
+	free(d.dfsNum);
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <assert.h>
+#include "perfcnt.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+static int perfOpenEvent(unsigned long long config)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	/* This thread, on any cpu */
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static long long perfRead(int fd)
+{
+	long long val;
+
+	if (read(fd, &val, sizeof(val)) != sizeof(val))
+		return -1;
+
+	return val;
+}
+
+void perfOpen(PerfCounter *pCnt)
+{
+	pCnt->missFd = perfOpenEvent(PERF_COUNT_HW_CACHE_MISSES);
+	pCnt->refFd = perfOpenEvent(PERF_COUNT_HW_CACHE_REFERENCES);
+	pCnt->misses = pCnt->refs = -1;
+
+	if (pCnt->missFd < 0 || pCnt->refFd < 0)
+		perfClose(pCnt);
+}
+
+void perfClose(PerfCounter *pCnt)
+{
+	if (pCnt->missFd >= 0)
+		close(pCnt->missFd);
+	if (pCnt->refFd >= 0)
+		close(pCnt->refFd);
+
+	pCnt->missFd = pCnt->refFd = -1;
+}
+
+void perfStart(PerfCounter *pCnt)
+{
+	if (pCnt->missFd < 0)
+		return;
+
+	ioctl(pCnt->missFd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(pCnt->refFd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(pCnt->missFd, PERF_EVENT_IOC_ENABLE, 0);
+	ioctl(pCnt->refFd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+void perfStop(PerfCounter *pCnt)
+{
+	if (pCnt->missFd < 0)
+		return;
+
+	ioctl(pCnt->missFd, PERF_EVENT_IOC_DISABLE, 0);
+	ioctl(pCnt->refFd, PERF_EVENT_IOC_DISABLE, 0);
+	pCnt->misses = perfRead(pCnt->missFd);
+	pCnt->refs = perfRead(pCnt->refFd);
+}
+
+#else
+
+void perfOpen(PerfCounter *pCnt)
+{
+	pCnt->missFd = pCnt->refFd = -1;
+	pCnt->misses = pCnt->refs = -1;
+}
+
+void perfClose(PerfCounter *pCnt)
+{
+}
+
+void perfStart(PerfCounter *pCnt)
+{
+}
+
+void perfStop(PerfCounter *pCnt)
+{
+}
+
+#endif
+
+void perfReport(PerfCounter *pCnt, FILE *file, const char *title)
+{
+	if (pCnt->missFd < 0 || pCnt->misses < 0) {
+		fprintf(file, "%s: cache counters not available\n", title);
+		return;
+	}
+
+	fprintf(file, "%s: %lld cache misses of %lld references\n", 
+		title, pCnt->misses, pCnt->refs);
+}
@@ -0,0 +1,27 @@
+#ifndef _PERF_CNT_H_
+#define _PERF_CNT_H_
+
+#include "config.h"
+#include "system.h"
+
+/*
+ * Hardware cache counters of the calling thread, read through
+ * perf_event_open. Where the kernel or the machine does not provide
+ * them the counters stay closed and every call is a no-op.
+ */
+typedef struct PerfCounter {
+	/* Counter descriptors, -1 when not available */
+	int missFd;
+	int refFd;
+	/* Values of the last perfStart()/perfStop() pair */
+	long long misses;
+	long long refs;
+} PerfCounter;
+
+void perfOpen(PerfCounter *pCnt);
+void perfClose(PerfCounter *pCnt);
+void perfStart(PerfCounter *pCnt);
+void perfStop(PerfCounter *pCnt);
+void perfReport(PerfCounter *pCnt, FILE *file, const char *title);
+
+#endif
@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <time.h>
+#include "stats.h"
+
+FILE *gStatsFile = NULL;
+
+static const char *phaseNames[PHASE_NUM] = {
+	"key", "walk", "intern", "init", "solve", "finish", "free",
+};
+
+/* Sums over all functions, written by statsFin() */
+static FuncStats statsTotal;
+static int statsFuncNum;
+static int statsCachedNum;
+static int statsSparseNum;
+static int statsTooLongNum;
+static int statsPeakSet;
+static double statsStart;
+
+double statsNow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void statsInit(void)
+{
+	char *path = getenv("CS502_STATS");
+
+	gStatsFile = NULL;
+	memset(&statsTotal, 0, sizeof(FuncStats));
+	statsFuncNum = statsCachedNum = statsSparseNum = statsPeakSet = 0;
+	statsTooLongNum = 0;
+
+	if (!path)
+		return;
+
+	gStatsFile = fopen(path, "w");
+	if (!gStatsFile) {
+		fprintf(stderr, "cannot open stats file %s\n", path);
+		return;
+	}
+
+	statsStart = statsNow();
+	fprintf(gStatsFile, "{\"functions\": [");
+}
+
+/* Phase times in microseconds, as one JSON object */
+static void statsPhases(FILE *file, FuncStats *pStats)
+{
+	int i;
+
+	fprintf(file, "\"time_us\": {");
+	for (i=0; i<PHASE_NUM; i++) {
+		fprintf(file, "%s\"%s\": %.1f", i ? ", " : "", phaseNames[i],
+			pStats->phaseTime[i] * 1e6);
+	}
+	fprintf(file, "}");
+}
+
+static void statsCounters(FILE *file, FuncStats *pStats)
+{
+	fprintf(file, "\"nodes\": %d, \"binds\": %d, \"variables\": %d, "
+		"\"blocks\": %d, \"iterations\": %d, \"visits\": %d, "
+		"\"unions\": %ld, ", pStats->nodeNum, pStats->bindNum, 
+		pStats->varNum, pStats->blockNum, pStats->iterNum, 
+		pStats->visitNum, pStats->unionNum);
+}
+
+/* 
+ * Write the stats of one function and add them to the totals. Called
+ * by the main thread in cgraph order, like output.txt is written.
+ */
+void statsFunc(const char *funcName, FuncStats *pStats)
+{
+	FILE *file = gStatsFile;
+	const char *ch;
+	int i;
+
+	fprintf(file, "%s\n  {\"name\": \"", statsFuncNum ? "," : "");
+	for (ch=funcName; *ch; ch++) {
+		if (*ch == '"' || *ch == '\\')
+			fputc('\\', file);
+		fputc(*ch, file);
+	}
+	fprintf(file, "\", \"cached\": %s, ", pStats->cached ? "true" : "false");
+
+	if (!pStats->cached) {
+		fprintf(file, "\"engine\": \"%s\", \"too_long\": %s, ", 
+			pStats->sparse ? "sparse" : "dense", 
+			pStats->tooLong ? "true" : "false");
+		statsCounters(file, pStats);
+		fprintf(file, "\"set_words\": %d, \"peak_set\": %d, ", 
+			pStats->setWords, pStats->peakSet);
+	}
+
+	statsPhases(file, pStats);
+	fprintf(file, "}");
+
+	for (i=0; i<PHASE_NUM; i++)
+		statsTotal.phaseTime[i] += pStats->phaseTime[i];
+	statsTotal.nodeNum += pStats->nodeNum;
+	statsTotal.bindNum += pStats->bindNum;
+	statsTotal.varNum += pStats->varNum;
+	statsTotal.blockNum += pStats->blockNum;
+	statsTotal.iterNum += pStats->iterNum;
+	statsTotal.visitNum += pStats->visitNum;
+	statsTotal.unionNum += pStats->unionNum;
+	if (pStats->peakSet > statsPeakSet)
+		statsPeakSet = pStats->peakSet;
+
+	statsFuncNum++;
+	statsCachedNum += pStats->cached;
+	statsSparseNum += pStats->sparse;
+	statsTooLongNum += pStats->tooLong;
+}
+
+/* Write the totals and close the file */
+void statsFin(int threadNum)
+{
+	FILE *file = gStatsFile;
+
+	if (!file)
+		return;
+
+	fprintf(file, "\n],\n\"total\": {\"functions\": %d, \"cached\": %d, "
+		"\"too_long\": %d, \"sparse\": %d, ", statsFuncNum, statsCachedNum, 
+		statsTooLongNum, statsSparseNum);
+	statsCounters(file, &statsTotal);
+	fprintf(file, "\"peak_set\": %d, ", statsPeakSet);
+	statsPhases(file, &statsTotal);
+	fprintf(file, ", \"threads\": %d, \"wall_us\": %.1f}}\n", threadNum,
+		(statsNow() - statsStart) * 1e6);
+
+	fclose(file);
+	gStatsFile = NULL;
+}
@@ -0,0 +1,73 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include "config.h"
+#include "system.h"
+
+/*
+ * Per-function phase times and counters. With CS502_STATS set to a
+ * file name, every analyzed function is written to that file as one
+ * JSON object, followed by the totals of the run. With it unset no
+ * clock is read and every stats point is one predicted-not-taken
+ * branch.
+ */
+typedef enum StatPhase {
+	/* funcKey() for the cache */
+	PHASE_KEY = 0,
+	/* walkStmt(), interning included */
+	PHASE_WALK,
+	/* newOperand() alone, a part of PHASE_WALK */
+	PHASE_INTERN,
+	/* initDFA() and the dense block layout */
+	PHASE_INIT,
+	/* beginDFA() or sparseDFA() */
+	PHASE_SOLVE,
+	/* Node sets recovered and finDFA() */
+	PHASE_FINISH,
+	/* fin() */
+	PHASE_FREE,
+	PHASE_NUM,
+} StatPhase;
+
+typedef struct FuncStats {
+	/* Seconds spent in every phase */
+	double phaseTime[PHASE_NUM];
+	int nodeNum;
+	int bindNum;
+	int varNum;
+	int blockNum;
+	int iterNum;
+	int visitNum;
+	/* Set unions of the solver, see AnalysisCtx.dfaUnionNum */
+	long unionNum;
+	/* Words of every set, and most variables in one solved set */
+	int setWords;
+	int peakSet;
+	bool sparse;
+	bool cached;
+	/* Result too long for the cache, see CACHE_TEXT_MAX */
+	bool tooLong;
+} FuncStats;
+
+/* Set by statsInit() before any analysis, NULL when stats are off */
+extern FILE *gStatsFile;
+
+#define STATS_ON()	__builtin_expect(gStatsFile != NULL, 0)
+
+double statsNow(void);
+
+/* Add the time since *pMark to phase and move the mark to now */
+static inline void statsLap(FuncStats *pStats, StatPhase phase, 
+	double *pMark)
+{
+	double now = statsNow();
+
+	pStats->phaseTime[phase] += now - *pMark;
+	*pMark = now;
+}
+
+void statsInit(void);
+void statsFunc(const char *funcName, FuncStats *pStats);
+void statsFin(int threadNum);
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef _STUB_CGRAPH_H_
+#define _STUB_CGRAPH_H_
+
+/* See stub/tree.h */
+#define GTY(x)
+
+#endif
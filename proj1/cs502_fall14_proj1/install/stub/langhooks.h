@@ -0,0 +1 @@
+/* Empty stand-in for the gcc header, see stub/tree.h */
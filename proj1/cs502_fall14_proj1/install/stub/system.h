@@ -0,0 +1,25 @@
+#ifndef _STUB_SYSTEM_H_
+#define _STUB_SYSTEM_H_
+
+/* libc and the x* allocators of libiberty, see stub/tree.h */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+/* What went through the x* allocators since the last allocReset() */
+typedef struct AllocStats {
+	long allocNum;
+	long allocBytes;
+} AllocStats;
+
+extern AllocStats gAllocStats;
+
+void *xmalloc(size_t size);
+void *xcalloc(size_t num, size_t size);
+void *xrealloc(void *ptr, size_t size);
+void allocReset(void);
+long allocHeap(void);
+
+#endif
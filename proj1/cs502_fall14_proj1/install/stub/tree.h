@@ -0,0 +1,39 @@
+#ifndef _STUB_TREE_H_
+#define _STUB_TREE_H_
+
+/*
+ * Stand-ins for the gcc headers, for tools built without gcc (see the
+ * cfgload target of the Makefile). Only what dfa.c and csproj2.h use
+ * is here. Trees only model declarations: a code, a name and the
+ * DECL_CHAIN link.
+ */
+enum tree_code {
+	ERROR_MARK = 0,
+	VAR_DECL,
+	PARM_DECL,
+	TYPE_DECL,
+	IDENTIFIER_NODE,
+	MAX_TREE_CODES
+};
+
+typedef struct tree_node *tree;
+
+struct tree_node {
+	enum tree_code code;
+	tree name;
+	tree chain;
+	char *ident;
+};
+
+typedef struct tree_stmt_iterator {
+	tree *ptr;
+} tree_stmt_iterator;
+
+extern const char *tree_code_name[];
+
+#define TREE_CODE(t)			((t)->code)
+#define DECL_NAME(t)			((t)->name)
+#define DECL_CHAIN(t)			((t)->chain)
+#define IDENTIFIER_POINTER(t)	((t)->ident)
+
+#endif
@@ -0,0 +1,64 @@
+#include "system.h"
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+#include <malloc.h>
+#define HAVE_MALLINFO2
+#endif
+
+AllocStats gAllocStats;
+
+/* Bytes of heap in use, 0 where the C library cannot tell */
+long allocHeap(void)
+{
+#ifdef HAVE_MALLINFO2
+	struct mallinfo2 info = mallinfo2();
+
+	return info.uordblks + info.hblkhd;
+#else
+	return 0;
+#endif
+}
+
+static void allocNote(size_t size)
+{
+	gAllocStats.allocNum++;
+	gAllocStats.allocBytes += size;
+}
+
+void *xmalloc(size_t size)
+{
+	void *ptr = malloc(size ? size : 1);
+
+	if (!ptr)
+		abort();
+
+	allocNote(size);
+	return ptr;
+}
+
+void *xcalloc(size_t num, size_t size)
+{
+	void *ptr = calloc(num ? num : 1, size ? size : 1);
+
+	if (!ptr)
+		abort();
+
+	allocNote(num * size);
+	return ptr;
+}
+
+void *xrealloc(void *ptr, size_t size)
+{
+	ptr = realloc(ptr, size ? size : 1);
+
+	if (!ptr)
+		abort();
+
+	allocNote(size);
+	return ptr;
+}
+
+void allocReset(void)
+{
+	memset(&gAllocStats, 0, sizeof(AllocStats));
+}
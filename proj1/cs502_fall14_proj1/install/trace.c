@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <assert.h>
+#include "trace.h"
+
+/* Buffer of a trace file, trace output is written in large blocks */
+#define TRACE_BUF_SIZE	(1024 * 1024)
+
+TraceLevel gTraceLevel = TRACE_OFF;
+FILE *gTraceFile = NULL;
+
+static char *traceBuf;
+
+static TraceLevel parseTraceLevel(const char *env)
+{
+	if (strcmp(env, "cfg") == 0)
+		return TRACE_CFG;
+	if (strcmp(env, "node") == 0)
+		return TRACE_NODE;
+	if (strcmp(env, "off") == 0)
+		return TRACE_OFF;
+
+	switch (atoi(env)) {
+	case 0:
+		return TRACE_OFF;
+	case 1:
+		return TRACE_CFG;
+	default:
+		return TRACE_NODE;
+	}
+}
+
+void traceInit(void)
+{
+	char *env = getenv("CS502_TRACE");
+	char *path = getenv("CS502_TRACE_FILE");
+
+	gTraceLevel = env ? parseTraceLevel(env) : TRACE_OFF;
+	gTraceFile = stdout;
+
+	if (gTraceLevel == TRACE_OFF || !path)
+		return;
+
+	gTraceFile = fopen(path, "w");
+	if (!gTraceFile) {
+		fprintf(stderr, "cannot open trace file %s\n", path);
+		gTraceFile = stdout;
+		return;
+	}
+
+	traceBuf = (char *) xmalloc(TRACE_BUF_SIZE);
+	setvbuf(gTraceFile, traceBuf, _IOFBF, TRACE_BUF_SIZE);
+}
+
+void traceFin(void)
+{
+	if (gTraceFile && gTraceFile != stdout)
+		fclose(gTraceFile);
+	else if (gTraceFile)
+		fflush(gTraceFile);
+
+	free(traceBuf);
+	traceBuf = NULL;
+	gTraceFile = NULL;
+	gTraceLevel = TRACE_OFF;
+}
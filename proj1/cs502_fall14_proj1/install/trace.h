@@ -0,0 +1,31 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include "config.h"
+#include "system.h"
+
+/*
+ * Leveled tracing. The level is read once from CS502_TRACE ("off",
+ * "cfg" or "node", or 0 to 2) and output goes to CS502_TRACE_FILE, or
+ * to stdout when it is unset. With tracing off every trace point is a
+ * single predicted-not-taken branch.
+ */
+typedef enum TraceLevel {
+	/* No tracing */
+	TRACE_OFF = 0,
+	/* Source tree, CFG dump and solver statistics per function */
+	TRACE_CFG,
+	/* Additionally one line per tree node visited by walkStmt */
+	TRACE_NODE,
+} TraceLevel;
+
+/* Set by traceInit() before any analysis and read-only afterwards */
+extern TraceLevel gTraceLevel;
+extern FILE *gTraceFile;
+
+#define TRACE_ON(level)	__builtin_expect(gTraceLevel >= (level), 0)
+
+void traceInit(void);
+void traceFin(void);
+
+#endif
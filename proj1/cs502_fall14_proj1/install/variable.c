@@ -0,0 +1,78 @@
+/*
+ * Interning of variables, shared by csproj2.c and dfabench. A variable
+ * declared in a bind is keyed by the bind and its decl index, any
+ * other one by its name. Finding the declaring bind of an operand is
+ * up to the caller.
+ */
+#include <stdio.h>
+#include <assert.h>
+#include "csproj2.h"
+
+static bool cmpEqual(void *a, void *b)
+{
+	Variable *pA = (Variable *)a;
+	Variable *pB = (Variable *)b;
+
+	if (pA->pBind || pB->pBind)
+		return pA->pBind == pB->pBind && pA->declIdx == pB->declIdx;
+
+	return strcmp(pA->name, pB->name) == 0;
+}
+
+static unsigned int hashVar(Variable *pVar)
+{
+	if (!pVar->pBind)
+		return hashing(pVar->name, strlen(pVar->name));
+
+	return hashPair(pVar->pBind->scopeId, pVar->declIdx);
+}
+
+/* 
+ * Intern a new variable and give it the next dense id. pBind and
+ * declIdx locate its declaration, pBind is NULL if it has none.
+ */
+static Variable *newVariable(AnalysisCtx *pCtx, char *name, CFGNode *pBind,
+	tree decl, int declIdx)
+{
+	Variable *pVar = (Variable *) arenaAlloc(&pCtx->arena, sizeof(Variable));
+
+	if (pCtx->varNum == pCtx->varCap) {
+		pCtx->varCap = pCtx->varCap ? pCtx->varCap << 1 : 64;
+		pCtx->varList = 
+			(Variable **) xrealloc(pCtx->varList, 
+				sizeof(Variable *) * pCtx->varCap);
+	}
+
+	pVar->name = name;
+	pVar->id = pCtx->varNum;
+	pVar->pBind = pBind;
+	pVar->decl = decl;
+	pVar->declIdx = declIdx;
+	pCtx->varList[pCtx->varNum++] = pVar;
+
+	return pVar;
+}
+
+/* 
+ * The variable declared as decl number declIdx of pBind, or the one
+ * named name if pBind is NULL. It is created on first use.
+ */
+Variable *internVar(AnalysisCtx *pCtx, char *name, CFGNode *pBind,
+	tree decl, int declIdx)
+{
+	Variable key, *pVar;
+	unsigned int hashVal;
+
+	key.name = name;
+	key.pBind = pBind;
+	key.declIdx = declIdx;
+	hashVal = hashVar(&key);
+	pVar = hashLookupTable(pCtx->varTable, hashVal, cmpEqual, &key, false);
+
+	if (!pVar) {
+		pVar = hashLookupTable(pCtx->varTable, hashVal, cmpEqual, 
+			newVariable(pCtx, name, pBind, decl, declIdx), true);
+	}
+
+	return pVar;
+}